@@ -249,6 +249,7 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, TCGTBCPUState s)
     if (tb == NULL) {
         return NULL;
     }
+    tcg_region_touch(tb);
 
     jc->array[hash].pc = s.pc;
     qatomic_set(&jc->array[hash].tb, tb);
@@ -889,6 +890,11 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
 {
     trace_exec_tb(tb, pc);
     tb = cpu_tb_exec(cpu, tb, tb_exit);
+    if (*tb_exit == TB_EXIT_HOT) {
+        /* tb is about to be replaced; cpu_exec_loop will tier it up. */
+        *last_tb = NULL;
+        return;
+    }
     if (*tb_exit != TB_EXIT_REQUESTED) {
         *last_tb = tb;
         return;
@@ -980,6 +986,17 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 jc = cpu->tb_jmp_cache;
                 jc->array[h].pc = s.pc;
                 qatomic_set(&jc->array[h].tb, tb);
+            } else if (unlikely(tb->tier == TB_TIER_BASE &&
+                                qatomic_read(&tb->hotness) <= 0)) {
+                CPUJumpCache *jc;
+                uint32_t h;
+
+                tb = tb_tier_up(cpu, tb, s);
+
+                h = tb_jmp_cache_hash_func(s.pc);
+                jc = cpu->tb_jmp_cache;
+                jc->array[h].pc = s.pc;
+                qatomic_set(&jc->array[h].tb, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1082,6 +1099,7 @@ void tcg_exec_unrealizefn(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+    tb_spec_forget(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     tlb_destroy(cpu);
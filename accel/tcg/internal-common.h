@@ -18,6 +18,7 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern uint32_t tb_tier_threshold;
 
 extern bool icount_align_option;
 
@@ -48,6 +49,8 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 }
 
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s);
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             TCGTBCPUState s);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
@@ -136,7 +139,38 @@ void page_table_config_init(void);
 G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 #endif /* CONFIG_USER_ONLY */
 
+#ifdef CONFIG_USER_ONLY
+TranslationBlock *tb_cache_lookup(TCGTBCPUState s, tb_page_addr_t phys_pc);
+void tb_cache_drop(void);
+#else
+static inline TranslationBlock *tb_cache_lookup(TCGTBCPUState s,
+                                                tb_page_addr_t phys_pc)
+{
+    return NULL;
+}
+static inline void tb_cache_drop(void) { }
+#endif
+
+#ifndef CONFIG_USER_ONLY
+void tb_spec_init(unsigned n_threads);
+void tb_spec_request(CPUState *cpu, TCGTBCPUState s, TranslationBlock *tb,
+                     void *host_pc);
+void tb_spec_pause(void);
+void tb_spec_resume(void);
+void tb_spec_forget(CPUState *cpu);
+TranslationBlock *tb_gen_code_ahead(CPUState *cpu, TCGTBCPUState s,
+                                    tb_page_addr_t phys_pc, void *host_pc);
+#else
+static inline void tb_spec_request(CPUState *cpu, TCGTBCPUState s,
+                                   TranslationBlock *tb, void *host_pc)
+{
+}
+static inline void tb_spec_pause(void) { }
+static inline void tb_spec_resume(void) { }
+#endif
+
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
+void tb_evict_cold_region(void);
 void tb_set_jmp_target(TranslationBlock *tb, int n, uintptr_t addr);
 
 void tcg_get_stats(AccelState *accel, GString *buf);
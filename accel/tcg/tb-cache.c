@@ -0,0 +1,610 @@
+/*
+ * Persistent translation cache for user-mode emulation.
+ *
+ * A cache file holds an image of code_gen_buffer as it was when the
+ * guest exited, where the TranslationBlocks are in it, and a copy of
+ * each guest page they were translated from.  The image is loaded back
+ * at the same host address, so nothing in it needs relocating.  In
+ * exchange, the file is only used if everything the code refers to is
+ * where it was: the same QEMU binary at the same address, the same
+ * prologue, guest_base and code_gen_buffer.
+ *
+ * A loaded TB is linked in only when tb_gen_code() is about to
+ * translate the same block, and only if the guest pages still hold
+ * the bytes it was translated from.
+ *
+ * The file is host code that will be run, so the directory and the
+ * file must belong to the effective user and be writable by no one
+ * else.  The offsets in the file are checked against the image, so a
+ * damaged file cannot make QEMU write outside it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cacheflush.h"
+#include "qemu/error-report.h"
+#include "qemu/target-info.h"
+#include "exec/page-protection.h"
+#include "exec/target_page.h"
+#include "exec/translation-block.h"
+#include "accel/tcg/tb-cache.h"
+#include "tcg/tcg.h"
+#include "user/guest-base.h"
+#include "user/guest-host.h"
+#include "user/page-protection.h"
+#include "internal-common.h"
+#include "tb-internal.h"
+#include "tb-hash.h"
+
+#define TB_CACHE_MAGIC    "QEMUTBC"
+#define TB_CACHE_VERSION  1
+#define TB_CACHE_NO_PAGE  UINT32_MAX
+
+/*
+ * File layout, in host byte order: the header; the prologue, padded
+ * to 8 bytes; n_pages records of a guest page address followed by the
+ * page contents; n_entries TBCacheEntry; image_size bytes of image.
+ */
+typedef struct TBCacheHeader {
+    /* The file is used only if all of these match the running QEMU. */
+    char magic[8];
+    uint32_t version;
+    uint32_t tb_struct_size;
+    uint32_t page_size;
+    uint32_t prologue_size;
+    uint64_t exe_dev;
+    uint64_t exe_ino;
+    uint64_t exe_size;
+    uint64_t exe_mtime;
+    uint64_t anchor;        /* host address of a function in QEMU */
+    uint64_t guest_base;
+    uint64_t image_base;    /* host address of the image, i.e. rx */
+
+    uint64_t image_size;
+    uint32_t n_pages;
+    uint32_t n_entries;
+} TBCacheHeader;
+
+#define TB_CACHE_ID_SIZE  offsetof(TBCacheHeader, image_size)
+
+typedef struct TBCacheEntry {
+    uint64_t tb_offset;     /* of the TranslationBlock in the image */
+    uint32_t page[2];       /* its pages, or TB_CACHE_NO_PAGE */
+} TBCacheEntry;
+
+/* What tb_lookup() matches a TB on. */
+typedef struct TBCacheKey {
+    tb_page_addr_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBCacheKey;
+
+/* A loaded TB that has not been looked up yet. */
+typedef struct TBCachePending {
+    TBCacheKey key;
+    TranslationBlock *tb;
+    vaddr page_addr[2];
+    const uint8_t *page[2]; /* saved contents; page[1] may be NULL */
+} TBCachePending;
+
+static struct {
+    char *path;             /* NULL if the cache is not in use */
+    TBCacheHeader id;
+    GMappedFile *file;
+    TBCachePending *loaded;
+    GHashTable *pending;    /* TBCacheKey -> TBCachePending */
+    unsigned translated;    /* TBs translated afresh since loading */
+} tb_cache;
+
+static guint tb_cache_key_hash(gconstpointer p)
+{
+    const TBCacheKey *k = p;
+
+    return tb_hash_func(k->pc, k->pc, k->flags, k->cs_base, k->cflags);
+}
+
+static gboolean tb_cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheKey *ka = a, *kb = b;
+
+    return ka->pc == kb->pc && ka->cs_base == kb->cs_base &&
+           ka->flags == kb->flags && ka->cflags == kb->cflags;
+}
+
+/* Fill in the identity part of @h for this process. */
+static bool tb_cache_identity(TBCacheHeader *h)
+{
+#ifdef CONFIG_TCG_INTERPRETER
+    /* TCI bytecode holds host pointers of its own; not supported. */
+    return false;
+#else
+    const void *prologue = (const void *)tcg_qemu_tb_exec;
+    const void *image = tcg_splitwx_to_rx(tcg_ctx->code_gen_buffer);
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) < 0) {
+        return false;
+    }
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, TB_CACHE_MAGIC, sizeof(h->magic));
+    h->version = TB_CACHE_VERSION;
+    h->tb_struct_size = sizeof(TranslationBlock);
+    h->page_size = TARGET_PAGE_SIZE;
+    h->prologue_size = image - prologue;
+    h->exe_dev = st.st_dev;
+    h->exe_ino = st.st_ino;
+    h->exe_size = st.st_size;
+    h->exe_mtime = st.st_mtime;
+    h->anchor = (uintptr_t)tb_cache_load;
+    h->guest_base = guest_base;
+    h->image_base = (uintptr_t)image;
+    return true;
+#endif
+}
+
+/*
+ * May code be taken from what @st describes?  Only if the effective
+ * user owns it and nobody else can write to it.
+ */
+static bool tb_cache_trusted(const char *path, const struct stat *st)
+{
+    if (st->st_uid != geteuid() || (st->st_mode & (S_IWGRP | S_IWOTH))) {
+        warn_report("tb-cache: not using %s: it must belong to you "
+                    "and not be writable by group or others", path);
+        return false;
+    }
+    return true;
+}
+
+/* Do the jumps of @tb, if any, lie within its code? */
+static bool tb_cache_jmp_ok(const TranslationBlock *tb, int n)
+{
+    return tb->jmp_reset_offset[n] == TB_JMP_OFFSET_INVALID ||
+           (tb->jmp_reset_offset[n] < tb->tc.size &&
+            tb->jmp_insn_offset[n] < tb->tc.size);
+}
+
+static size_t tb_cache_page_rec_size(void)
+{
+    return sizeof(uint64_t) + TARGET_PAGE_SIZE;
+}
+
+/*
+ * Copy the image of the mapped cache file into code_gen_buffer and
+ * record its TBs as pending.  Returns false if the file does not fit
+ * this process, in which case code_gen_buffer is left untouched.
+ */
+static bool tb_cache_parse(const uint8_t *data, size_t len)
+{
+    const TBCacheHeader *h = (const TBCacheHeader *)data;
+    size_t page_rec = tb_cache_page_rec_size();
+    size_t room = tcg_ctx->code_gen_highwater - tcg_ctx->code_gen_buffer;
+    const uint8_t *pages, *image;
+    const TBCacheEntry *e;
+    uint64_t need;
+    uint32_t i;
+
+    if (len < sizeof(*h) || memcmp(h, &tb_cache.id, TB_CACHE_ID_SIZE)) {
+        return false;
+    }
+    need = sizeof(*h) + ROUND_UP(h->prologue_size, 8)
+        + (uint64_t)h->n_pages * page_rec
+        + (uint64_t)h->n_entries * sizeof(TBCacheEntry);
+    if (h->image_size > len || need + h->image_size != len) {
+        return false;
+    }
+    /*
+     * Dead code is never dropped from the image, so let it grow to half
+     * of code_gen_buffer at most; then start over from this run's code.
+     */
+    if (h->image_size > room / 2) {
+        return false;
+    }
+    if (memcmp(data + sizeof(*h), (const void *)tcg_splitwx_to_rx(
+                   tcg_ctx->code_gen_buffer) - h->prologue_size,
+               h->prologue_size)) {
+        return false;
+    }
+
+    pages = data + sizeof(*h) + ROUND_UP(h->prologue_size, 8);
+    e = (const TBCacheEntry *)(pages + (size_t)h->n_pages * page_rec);
+    image = (const uint8_t *)(e + h->n_entries);
+
+    qemu_thread_jit_write();
+    memcpy(tcg_ctx->code_gen_buffer, image, h->image_size);
+    flush_idcache_range((uintptr_t)tcg_splitwx_to_rx(tcg_ctx->code_gen_buffer),
+                        (uintptr_t)tcg_ctx->code_gen_buffer, h->image_size);
+    qatomic_set(&tcg_ctx->code_gen_ptr,
+                tcg_ctx->code_gen_buffer + h->image_size);
+
+    tb_cache.loaded = g_new0(TBCachePending, h->n_entries);
+    for (i = 0; i < h->n_entries; i++) {
+        TBCachePending *p = &tb_cache.loaded[i];
+        const void *end = tcg_splitwx_to_rx(tcg_ctx->code_gen_ptr);
+        TranslationBlock *tb;
+        int n;
+
+        if (h->image_size < sizeof(*tb) ||
+            e[i].tb_offset > h->image_size - sizeof(*tb) ||
+            e[i].page[0] == TB_CACHE_NO_PAGE) {
+            continue;
+        }
+        tb = tcg_ctx->code_gen_buffer + e[i].tb_offset;
+        if (!QEMU_PTR_IS_ALIGNED(tb, qemu_icache_linesize) ||
+            (tb->cflags & CF_INVALID) ||
+            tb->tc.ptr < tcg_splitwx_to_rx(tb + 1) || tb->tc.ptr > end ||
+            tb->tc.size > end - tb->tc.ptr ||
+            !tb_cache_jmp_ok(tb, 0) || !tb_cache_jmp_ok(tb, 1)) {
+            continue;
+        }
+
+        for (n = 0; n < 2; n++) {
+            const uint8_t *rec;
+
+            if (e[i].page[n] == TB_CACHE_NO_PAGE) {
+                continue;
+            }
+            if (e[i].page[n] >= h->n_pages) {
+                break;
+            }
+            rec = pages + (size_t)e[i].page[n] * page_rec;
+            p->page_addr[n] = *(const uint64_t *)rec;
+            p->page[n] = rec + sizeof(uint64_t);
+        }
+        if (n < 2 ||
+            p->page_addr[0] != (tb_page_addr0(tb) & TARGET_PAGE_MASK) ||
+            (p->page[1] ? p->page_addr[1] : -1) != tb_page_addr1(tb)) {
+            continue;
+        }
+
+        p->tb = tb;
+        p->key.pc = tb_page_addr0(tb);
+        p->key.cs_base = tb->cs_base;
+        p->key.flags = tb->flags;
+        p->key.cflags = tb->cflags;
+        if (!g_hash_table_contains(tb_cache.pending, &p->key)) {
+            g_hash_table_insert(tb_cache.pending, &p->key, p);
+        }
+    }
+    return true;
+}
+
+void tb_cache_load(const char *dir, const char *exec_path,
+                   const char *cpu_model)
+{
+    g_autoptr(GError) err = NULL;
+    g_autofree char *key = NULL;
+    g_autofree char *sum = NULL;
+    g_autofree char *base = NULL;
+    g_autofree char *path = NULL;
+    struct stat st;
+    int fd;
+
+    /* Nothing must have been translated yet. */
+    g_assert(tcg_ctx->code_gen_ptr == tcg_ctx->code_gen_buffer);
+
+    if (!tb_cache_identity(&tb_cache.id)) {
+        warn_report("tb-cache: not supported in this configuration");
+        return;
+    }
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        warn_report("tb-cache: cannot create %s: %s", dir, strerror(errno));
+        return;
+    }
+    /* It may have been there already, made by someone else. */
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        warn_report("tb-cache: %s is not a directory", dir);
+        return;
+    }
+    if (!tb_cache_trusted(dir, &st)) {
+        return;
+    }
+
+    key = g_strdup_printf("%s\n%s\n%s", target_name(), exec_path,
+                          cpu_model ? cpu_model : "");
+    sum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+    base = g_path_get_basename(exec_path);
+    path = g_strdup_printf("%s/%s-%.16s.tbc", dir, base, sum);
+
+    /* Check the file that is mapped, not whatever the name leads to. */
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            warn_report("tb-cache: cannot open %s: %s",
+                        path, strerror(errno));
+            return;
+        }
+        /* Not saved yet. */
+    } else {
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+            !tb_cache_trusted(path, &st)) {
+            close(fd);
+            return;
+        }
+        tb_cache.file = g_mapped_file_new_from_fd(fd, FALSE, &err);
+        close(fd);
+    }
+
+    tb_cache.path = g_steal_pointer(&path);
+    tb_cache.pending = g_hash_table_new(tb_cache_key_hash,
+                                        tb_cache_key_equal);
+    if (!tb_cache.file) {
+        return;
+    }
+    if (!tb_cache_parse((const uint8_t *)g_mapped_file_get_contents(
+                            tb_cache.file),
+                        g_mapped_file_get_length(tb_cache.file))) {
+        g_mapped_file_unref(tb_cache.file);
+        tb_cache.file = NULL;
+    }
+}
+
+static bool tb_cache_page_matches(const TBCachePending *p, int n)
+{
+    vaddr addr = p->page_addr[n];
+
+    if (!p->page[n]) {
+        return true;
+    }
+    return (page_get_flags(addr) & PAGE_EXEC) &&
+           memcmp(g2h_untagged(addr), p->page[n], TARGET_PAGE_SIZE) == 0;
+}
+
+/*
+ * Called by tb_gen_code() with mmap_lock held, before it translates
+ * the block at @phys_pc.  Returns the loaded TB for that block, linked
+ * in as tb_gen_code() would have done, or NULL if it has to translate.
+ */
+TranslationBlock *tb_cache_lookup(TCGTBCPUState s, tb_page_addr_t phys_pc)
+{
+    TBCacheKey key = {
+        .pc = phys_pc,
+        .cs_base = s.cs_base,
+        .flags = s.flags,
+        .cflags = s.cflags,
+    };
+    TranslationBlock *tb, *existing;
+    TBCachePending *p;
+
+    if (!tb_cache.pending) {
+        return NULL;
+    }
+
+    /* Either way, the entry is used up. */
+    p = g_hash_table_lookup(tb_cache.pending, &key);
+    if (p) {
+        g_hash_table_remove(tb_cache.pending, &key);
+    }
+    if (!p) {
+        tb_cache.translated++;
+        return NULL;
+    }
+
+    /*
+     * Write-protect the pages before comparing them, so that a guest
+     * store after the comparison faults and invalidates the TB.  On a
+     * mismatch the pages stay protected, as after any translation,
+     * until the next store to them.
+     */
+    tb_lock_page0(phys_pc);
+    if (p->page[1]) {
+        tb_lock_page1(phys_pc, p->page_addr[1]);
+    }
+    if (!tb_cache_page_matches(p, 0) || !tb_cache_page_matches(p, 1)) {
+        if (p->page[1]) {
+            tb_unlock_page1(phys_pc, p->page_addr[1]);
+        }
+        tb_cache.translated++;
+        return NULL;
+    }
+
+    /* Reset what only made sense in the process that saved it. */
+    tb = p->tb;
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+    if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+    if (tb->tier == TB_TIER_BASE) {
+        uint32_t threshold = qatomic_read(&tb_tier_threshold);
+        tb->hotness = threshold ? threshold : INT32_MAX;
+    }
+
+    tcg_tb_insert(tb);
+    existing = tb_link_page(tb);
+    if (unlikely(existing != tb)) {
+        tcg_tb_remove(tb);
+    }
+    return existing;
+}
+
+/* Called by tb_flush, which has just reset code_gen_buffer. */
+void tb_cache_drop(void)
+{
+    if (tb_cache.pending) {
+        g_hash_table_remove_all(tb_cache.pending);
+    }
+}
+
+typedef struct TBCacheSavePage {
+    vaddr addr;
+    const uint8_t *data;
+} TBCacheSavePage;
+
+typedef struct TBCacheSave {
+    GArray *pages;          /* TBCacheSavePage */
+    GHashTable *page_index; /* page address -> index + 1 */
+    GArray *entries;        /* TBCacheEntry */
+} TBCacheSave;
+
+/*
+ * Return the index of the page at @addr, adding it with contents @data
+ * if it is new, or TB_CACHE_NO_PAGE if it was added with other contents.
+ */
+static uint32_t tb_cache_save_page(TBCacheSave *sv, vaddr addr,
+                                   const uint8_t *data)
+{
+    gpointer key = (gpointer)(uintptr_t)addr;
+    guint idx = GPOINTER_TO_UINT(g_hash_table_lookup(sv->page_index, key));
+    TBCacheSavePage pg = { .addr = addr, .data = data };
+
+    if (idx) {
+        const TBCacheSavePage *old = &g_array_index(sv->pages,
+                                                    TBCacheSavePage, idx - 1);
+        if (old->data != data && memcmp(old->data, data, TARGET_PAGE_SIZE)) {
+            return TB_CACHE_NO_PAGE;
+        }
+        return idx - 1;
+    }
+    g_array_append_val(sv->pages, pg);
+    g_hash_table_insert(sv->page_index, key, GUINT_TO_POINTER(sv->pages->len));
+    return sv->pages->len - 1;
+}
+
+static gboolean tb_cache_save_live(gpointer key, gpointer value,
+                                   gpointer data)
+{
+    TBCacheSave *sv = data;
+    TranslationBlock *tb = value;
+    tb_page_addr_t p0 = tb_page_addr0(tb) & TARGET_PAGE_MASK;
+    tb_page_addr_t p1 = tb_page_addr1(tb);
+    TBCacheEntry e = {
+        .tb_offset = (void *)tb - tcg_ctx->code_gen_buffer,
+        .page = { TB_CACHE_NO_PAGE, TB_CACHE_NO_PAGE },
+    };
+
+    if ((tb_cflags(tb) & CF_INVALID) || tb_page_addr0(tb) == -1 ||
+        !(page_get_flags(p0) & PAGE_VALID) ||
+        (p1 != -1 && !(page_get_flags(p1) & PAGE_VALID))) {
+        return false;
+    }
+    e.page[0] = tb_cache_save_page(sv, p0, g2h_untagged(p0));
+    if (p1 != -1) {
+        e.page[1] = tb_cache_save_page(sv, p1, g2h_untagged(p1));
+    }
+    g_array_append_val(sv->entries, e);
+    return false;
+}
+
+static void tb_cache_save_pending(TBCacheSave *sv)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, tb_cache.pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const TBCachePending *p = value;
+        TBCacheEntry e = {
+            .tb_offset = (void *)p->tb - tcg_ctx->code_gen_buffer,
+            .page = { TB_CACHE_NO_PAGE, TB_CACHE_NO_PAGE },
+        };
+
+        /* Drop it if a live TB has seen newer contents of its pages. */
+        e.page[0] = tb_cache_save_page(sv, p->page_addr[0], p->page[0]);
+        if (e.page[0] == TB_CACHE_NO_PAGE) {
+            continue;
+        }
+        if (p->page[1]) {
+            e.page[1] = tb_cache_save_page(sv, p->page_addr[1], p->page[1]);
+            if (e.page[1] == TB_CACHE_NO_PAGE) {
+                continue;
+            }
+        }
+        g_array_append_val(sv->entries, e);
+    }
+}
+
+static bool tb_cache_write(int fd, TBCacheSave *sv)
+{
+    static const uint8_t zero[8];
+    TBCacheHeader h = tb_cache.id;
+    const void *prologue = tcg_splitwx_to_rx(tcg_ctx->code_gen_buffer)
+                           - h.prologue_size;
+    size_t pad = ROUND_UP(h.prologue_size, 8) - h.prologue_size;
+    guint i;
+
+    h.image_size = tcg_ctx->code_gen_ptr - tcg_ctx->code_gen_buffer;
+    h.n_pages = sv->pages->len;
+    h.n_entries = sv->entries->len;
+
+    if (qemu_write_full(fd, &h, sizeof(h)) != sizeof(h) ||
+        qemu_write_full(fd, prologue, h.prologue_size) != h.prologue_size ||
+        qemu_write_full(fd, zero, pad) != pad) {
+        return false;
+    }
+    for (i = 0; i < sv->pages->len; i++) {
+        const TBCacheSavePage *pg = &g_array_index(sv->pages,
+                                                   TBCacheSavePage, i);
+        uint64_t addr = pg->addr;
+
+        if (qemu_write_full(fd, &addr, sizeof(addr)) != sizeof(addr) ||
+            qemu_write_full(fd, pg->data, TARGET_PAGE_SIZE)
+            != TARGET_PAGE_SIZE) {
+            return false;
+        }
+    }
+    return qemu_write_full(fd, sv->entries->data,
+                           h.n_entries * sizeof(TBCacheEntry))
+           == h.n_entries * sizeof(TBCacheEntry) &&
+           qemu_write_full(fd, tcg_ctx->code_gen_buffer, h.image_size)
+           == h.image_size;
+}
+
+void tb_cache_save(void)
+{
+    g_autofree char *tmp = NULL;
+    TBCacheSave sv;
+    bool ok;
+    int fd;
+
+    if (!tb_cache.path || !tb_cache.translated) {
+        return;
+    }
+
+    /* Another thread could translate, or exit and save, meanwhile. */
+    mmap_lock();
+    if (!tb_cache.translated) {
+        mmap_unlock();
+        return;
+    }
+    tb_cache.translated = 0;
+
+    sv.pages = g_array_new(false, false, sizeof(TBCacheSavePage));
+    sv.page_index = g_hash_table_new(NULL, NULL);
+    sv.entries = g_array_new(false, false, sizeof(TBCacheEntry));
+    tcg_tb_foreach(tb_cache_save_live, &sv);
+    tb_cache_save_pending(&sv);
+
+    /* Write a new file and rename it, for other processes reading it. */
+    tmp = g_strdup_printf("%s.XXXXXX", tb_cache.path);
+    fd = g_mkstemp(tmp);
+    if (fd < 0) {
+        ok = false;
+    } else {
+        ok = tb_cache_write(fd, &sv);
+        ok &= close(fd) == 0;
+        ok = ok && rename(tmp, tb_cache.path) == 0;
+        if (!ok) {
+            unlink(tmp);
+        }
+    }
+    mmap_unlock();
+
+    if (!ok) {
+        warn_report("tb-cache: cannot write %s: %s",
+                    tb_cache.path, strerror(errno));
+    }
+    g_array_free(sv.pages, true);
+    g_hash_table_destroy(sv.page_index);
+    g_array_free(sv.entries, true);
+}
@@ -35,6 +35,15 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_evict_count;        /* regions evicted */
+    unsigned tb_evict_tb_count;     /* TBs they held */
+    size_t tb_evict_size;           /* bytes of code they held */
+    unsigned tb_retranslate_count;  /* TBs translated again after eviction */
+    size_t tb_retranslate_size;     /* bytes of code generated for those */
+    unsigned tb_tier_up_count;      /* hot TBs retranslated as superblocks */
+    unsigned tb_trace_follow_count; /* direct jumps followed into them */
+    unsigned tb_spec_count;         /* TBs translated ahead of use */
+    unsigned tb_spec_drop_count;    /* requests to do so dropped */
 };
 
 extern TBContext tb_ctx;
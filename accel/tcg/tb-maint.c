@@ -18,8 +18,10 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
+#include "qemu/rcu.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/page-protection.h"
@@ -32,6 +34,7 @@
 #include "tcg/tcg.h"
 #include "tb-hash.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 #include "tb-internal.h"
 #include "internal-common.h"
 #ifdef CONFIG_USER_ONLY
@@ -64,6 +67,23 @@ static bool tb_cmp(const void *ap, const void *bp)
             tb_page_addr1(a) == tb_page_addr1(b));
 }
 
+/*
+ * Hashes of the TBs evicted since the last flush, so that translating
+ * one of them again can be counted as the cost of the eviction.
+ * Collisions only make the statistics a little pessimistic.
+ */
+#define TB_EVICTED_BITS 16
+#define TB_EVICTED_SIZE (1 << TB_EVICTED_BITS)
+static unsigned long tb_evicted_map[BITS_TO_LONGS(TB_EVICTED_SIZE)];
+
+static inline uint32_t tb_hash(const TranslationBlock *tb)
+{
+    return tb_hash_func(tb_page_addr0(tb),
+                        (tb_cflags(tb) & CF_PCREL ? 0 : tb->pc),
+                        tb->flags, tb->cs_base,
+                        tb_cflags(tb) & ~CF_INVALID);
+}
+
 void tb_htable_init(void)
 {
     unsigned int mode = QHT_MODE_AUTO_RESIZE;
@@ -776,6 +796,9 @@ void tb_flush__exclusive_or_serial(void)
     assert(!runstate_is_running() ||
            (current_cpu && cpu_in_serial_context(current_cpu)));
 
+    /* The threads translating ahead are not stopped with the vCPUs. */
+    tb_spec_pause();
+
     CPU_FOREACH(cpu) {
         tcg_flush_jmp_cache(cpu);
     }
@@ -784,8 +807,11 @@ void tb_flush__exclusive_or_serial(void)
     tb_remove_all();
 
     tcg_region_reset_all();
+    tb_cache_drop();
+    bitmap_zero(tb_evicted_map, TB_EVICTED_SIZE);
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
+    tb_spec_resume();
     qemu_plugin_flush_cb();
 }
 
@@ -1011,9 +1037,100 @@ TranslationBlock *tb_link_page(TranslationBlock *tb)
     }
 
     tb_unlock_pages(tb);
+
+    if (unlikely(test_bit(h & (TB_EVICTED_SIZE - 1), tb_evicted_map))) {
+        qatomic_inc(&tb_ctx.tb_retranslate_count);
+        qatomic_add(&tb_ctx.tb_retranslate_size, tb->tc.size);
+    }
     return tb;
 }
 
+typedef struct TBEviction {
+    struct rcu_head rcu;
+    TCGRegionEviction region;
+} TBEviction;
+
+static gboolean tb_evict_collect(gpointer key, gpointer value, gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Called after a grace period, once no vCPU can be running code from the
+ * evicted region or be about to put one of its TBs in its jump cache.
+ * Entries cached just before the TBs were invalidated may remain; clear
+ * them, and hand the region back for allocation.
+ */
+static void tb_evict_rcu(TBEviction *ev)
+{
+    CPUState *cpu;
+    unsigned int i;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+
+        if (jc == NULL) {
+            continue;
+        }
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            void *tb = qatomic_read(&jc->array[i].tb);
+
+            if (tb >= ev->region.start && tb < ev->region.end) {
+                qatomic_cmpxchg(&jc->array[i].tb, tb, NULL);
+            }
+        }
+    }
+    tcg_region_evict_end(&ev->region);
+    g_free(ev);
+}
+
+/*
+ * Evict the coldest region of the code buffer, if the region allocator
+ * is running short of free ones.  Unlike a flush, this invalidates only
+ * the TBs of that region and does not stop the other vCPUs, which may
+ * go on executing them until they next leave the execution loop.
+ * Called with mmap_lock held in user-mode, and with no page locks held.
+ */
+void tb_evict_cold_region(void)
+{
+    TBEviction *ev = g_new0(TBEviction, 1);
+    GPtrArray *tbs;
+    unsigned int i, n;
+
+    assert_memory_lock();
+    assert_no_pages_locked();
+
+    if (!tcg_region_evict_begin(&ev->region)) {
+        g_free(ev);
+        return;
+    }
+
+    /* Don't hold the tree lock: unwinding may look TBs up while we wait. */
+    tbs = g_ptr_array_new();
+    tcg_region_evict_foreach(&ev->region, tb_evict_collect, tbs);
+
+    n = 0;
+    for (i = 0; i < tbs->len; i++) {
+        TranslationBlock *tb = g_ptr_array_index(tbs, i);
+
+        if (tb_cflags(tb) & CF_INVALID) {
+            continue;
+        }
+        set_bit_atomic(tb_hash(tb) & (TB_EVICTED_SIZE - 1), tb_evicted_map);
+        tb_phys_invalidate(tb, -1);
+        n++;
+    }
+    g_ptr_array_free(tbs, true);
+
+    qatomic_inc(&tb_ctx.tb_evict_count);
+    qatomic_add(&tb_ctx.tb_evict_tb_count, n);
+    qatomic_add(&tb_ctx.tb_evict_size, ev->region.size);
+
+    call_rcu(ev, tb_evict_rcu, rcu);
+}
+
 #ifdef CONFIG_USER_ONLY
 /*
  * Invalidate all TBs which intersect with the target address range.
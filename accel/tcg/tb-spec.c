@@ -0,0 +1,245 @@
+/*
+ * Translating ahead of the vCPUs
+ *
+ * With MTTCG, a vCPU that misses in tb_lookup() stops running guest
+ * code while it translates.  Each new TB usually ends in direct jumps
+ * to blocks on the same page, which it is likely to reach soon.  Helper
+ * threads translate those blocks in the meantime and publish them in
+ * tb_ctx.htable, so that the vCPU finds them there instead.
+ *
+ * The vCPU never waits for the helpers: requests are dropped if their
+ * queue is busy or full.  The helpers cannot use the vCPU's TLB, so
+ * they only translate blocks on the page of the TB that led to them,
+ * and give up on those that reach into the next page.  Targets opt in
+ * with TCGCPUOps.translate_from_tb_flags.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/plugin.h"
+#include "exec/cpu-common.h"
+#include "exec/target_page.h"
+#include "exec/translation-block.h"
+#include "accel/tcg/cpu-ops.h"
+#include "hw/core/cpu.h"
+#include "tcg/tcg.h"
+#include "tcg/startup.h"
+#include "internal-common.h"
+#include "tb-context.h"
+#include "tb-hash.h"
+
+/* Requests kept; the oldest are dropped first.  A power of 2. */
+#define TB_SPEC_QUEUE_SIZE 256
+
+typedef struct TBSpecRequest {
+    CPUState *cpu;
+    TCGTBCPUState s;
+    tb_page_addr_t phys_pc;
+    void *host_pc;
+} TBSpecRequest;
+
+static struct {
+    QemuMutex lock;
+    QemuCond work_cond;     /* a request was queued, or resumed */
+    QemuCond idle_cond;     /* busy dropped to 0 */
+    TBSpecRequest queue[TB_SPEC_QUEUE_SIZE];
+    unsigned head, tail;    /* queued requests are [head, tail) */
+    unsigned busy;          /* helpers translating now */
+    unsigned paused;        /* nesting of tb_spec_pause() */
+    unsigned n_threads;
+} tb_spec;
+
+static bool tb_spec_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const TBSpecRequest *r = d;
+
+    return (tb_cflags(tb) & CF_PCREL || tb->pc == r->s.pc) &&
+           tb_page_addr0(tb) == r->phys_pc &&
+           tb->cs_base == r->s.cs_base &&
+           tb->flags == r->s.flags &&
+           tb_cflags(tb) == r->s.cflags;
+}
+
+static void tb_spec_translate(const TBSpecRequest *r)
+{
+    uint32_t h;
+
+    RCU_READ_LOCK_GUARD();
+
+    /* The RAM may have been unplugged since the request was made. */
+    if (qemu_ram_addr_from_host(r->host_pc) != r->phys_pc) {
+        return;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Translation callbacks must run on the vCPU thread. */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 r->cpu->plugin_state->event_mask)) {
+        return;
+    }
+#endif
+
+    h = tb_hash_func(r->phys_pc, (r->s.cflags & CF_PCREL ? 0 : r->s.pc),
+                     r->s.flags, r->s.cs_base, r->s.cflags);
+    if (qht_lookup_custom(&tb_ctx.htable, r, h, tb_spec_cmp)) {
+        return;
+    }
+    if (tb_gen_code_ahead(r->cpu, r->s, r->phys_pc, r->host_pc)) {
+        qatomic_inc(&tb_ctx.tb_spec_count);
+    }
+}
+
+static void *tb_spec_thread(void *arg)
+{
+    rcu_register_thread();
+    tcg_register_thread();
+    tcg_ctx->speculative = true;
+
+    qemu_mutex_lock(&tb_spec.lock);
+    while (true) {
+        TBSpecRequest r;
+
+        while (tb_spec.paused || tb_spec.head == tb_spec.tail) {
+            qemu_cond_wait(&tb_spec.work_cond, &tb_spec.lock);
+        }
+        /* Newest first: it is nearest to where the vCPU is now. */
+        r = tb_spec.queue[--tb_spec.tail % TB_SPEC_QUEUE_SIZE];
+        tb_spec.busy++;
+        qemu_mutex_unlock(&tb_spec.lock);
+
+        tb_spec_translate(&r);
+
+        qemu_mutex_lock(&tb_spec.lock);
+        if (--tb_spec.busy == 0) {
+            qemu_cond_broadcast(&tb_spec.idle_cond);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Start @n_threads helper threads.  Each needs a TCGContext of its
+ * own, which tcg_init() must have been told about.
+ */
+void tb_spec_init(unsigned n_threads)
+{
+    unsigned i;
+
+    if (n_threads == 0) {
+        return;
+    }
+    qemu_mutex_init(&tb_spec.lock);
+    qemu_cond_init(&tb_spec.work_cond);
+    qemu_cond_init(&tb_spec.idle_cond);
+    tb_spec.n_threads = n_threads;
+
+    for (i = 0; i < n_threads; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "TCG ahead", tb_spec_thread,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+/*
+ * Called by tb_gen_code() on the thread of @cpu, with no page locks
+ * held, once it has translated @tb for @s, from @host_pc.  Queue the
+ * destinations of its direct jumps to be translated ahead.
+ */
+void tb_spec_request(CPUState *cpu, TCGTBCPUState s, TranslationBlock *tb,
+                     void *host_pc)
+{
+    tb_page_addr_t page = tb_page_addr0(tb) & TARGET_PAGE_MASK;
+    int i, n = tcg_ctx->gen_nb_jmp_dest;
+
+    if (tb_spec.n_threads == 0 || n == 0 ||
+        !cpu->cc->tcg_ops->translate_from_tb_flags) {
+        return;
+    }
+    /* Leave the short-lived and debugging TBs to the vCPU. */
+    if (s.cflags & (CF_COUNT_MASK | CF_NO_GOTO_TB | CF_SINGLE_STEP |
+                    CF_BP_PAGE | CF_USE_ICOUNT | CF_NOIRQ)) {
+        return;
+    }
+    if (qemu_mutex_trylock(&tb_spec.lock)) {
+        qatomic_add(&tb_ctx.tb_spec_drop_count, n);
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        vaddr dest = tcg_ctx->gen_jmp_dest[i];
+        TBSpecRequest *r;
+
+        if (dest == s.pc) {
+            continue;
+        }
+        if (tb_spec.tail - tb_spec.head == TB_SPEC_QUEUE_SIZE) {
+            tb_spec.head++;
+            qatomic_inc(&tb_ctx.tb_spec_drop_count);
+        }
+        r = &tb_spec.queue[tb_spec.tail++ % TB_SPEC_QUEUE_SIZE];
+        r->cpu = cpu;
+        r->s = s;
+        r->s.pc = dest;
+        r->phys_pc = page | (dest & ~TARGET_PAGE_MASK);
+        r->host_pc = host_pc + (dest - s.pc);
+    }
+    qemu_cond_signal(&tb_spec.work_cond);
+    qemu_mutex_unlock(&tb_spec.lock);
+}
+
+/*
+ * Wait for the helpers to finish what they are translating, and keep
+ * them from starting anything else until tb_spec_resume().  Used by
+ * tb_flush, which resets the regions they translate into.
+ */
+void tb_spec_pause(void)
+{
+    if (tb_spec.n_threads == 0) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec.lock);
+    tb_spec.paused++;
+    while (tb_spec.busy) {
+        qemu_cond_wait(&tb_spec.idle_cond, &tb_spec.lock);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
+
+void tb_spec_resume(void)
+{
+    if (tb_spec.n_threads == 0) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec.lock);
+    if (--tb_spec.paused == 0) {
+        qemu_cond_broadcast(&tb_spec.work_cond);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
+
+/* Drop the requests of @cpu, which is being unrealized. */
+void tb_spec_forget(CPUState *cpu)
+{
+    unsigned i, n;
+
+    if (tb_spec.n_threads == 0) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec.lock);
+    for (i = n = tb_spec.head; i != tb_spec.tail; i++) {
+        TBSpecRequest *r = &tb_spec.queue[i % TB_SPEC_QUEUE_SIZE];
+
+        if (r->cpu != cpu) {
+            tb_spec.queue[n++ % TB_SPEC_QUEUE_SIZE] = *r;
+        }
+    }
+    tb_spec.tail = n;
+    while (tb_spec.busy) {
+        qemu_cond_wait(&tb_spec.idle_cond, &tb_spec.lock);
+    }
+    qemu_mutex_unlock(&tb_spec.lock);
+}
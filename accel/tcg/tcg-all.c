@@ -53,15 +53,22 @@ struct TCGState {
     OnOffAuto mttcg_enabled;
     bool one_insn_per_tb;
     int splitwx_enabled;
+    bool evict_regions;
     unsigned long tb_size;
+    uint32_t tier_threshold;
+    uint32_t spec_threads;
 };
 typedef struct TCGState TCGState;
 
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
 
+#define TCG_MAX_SPEC_THREADS 64
+
 DECLARE_INSTANCE_CHECKER(TCGState, TCG_STATE,
                          TYPE_TCG_ACCEL)
 
+uint32_t tb_tier_threshold;
+
 #ifndef CONFIG_USER_ONLY
 bool qemu_tcg_mttcg_enabled(void)
 {
@@ -144,6 +151,18 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
         g_assert_not_reached();
     }
 
+    if (s->spec_threads) {
+        if (s->mttcg_enabled == ON_OFF_AUTO_ON &&
+            cc->tcg_ops->translate_from_tb_flags) {
+            /* Each helper thread translates into regions of its own. */
+            max_threads += s->spec_threads;
+        } else {
+            warn_report("spec-threads needs thread=multi and a guest "
+                        "that supports it; ignored");
+            s->spec_threads = 0;
+        }
+    }
+
     qemu_add_vm_change_state_handler(tcg_vm_change_state, NULL);
 #endif
 
@@ -151,7 +170,8 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads);
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads,
+             s->evict_regions);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -161,6 +181,10 @@ static int tcg_init_machine(AccelState *as, MachineState *ms)
     tcg_prologue_init();
 #endif
 
+#ifndef CONFIG_USER_ONLY
+    tb_spec_init(s->spec_threads);
+#endif
+
 #ifdef CONFIG_USER_ONLY
     qdev_create_fake_machine();
 #endif
@@ -216,6 +240,64 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > INT32_MAX) {
+        error_setg(errp, "tier-threshold must be at most %d", INT32_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+    /* Only TBs translated from now on are counted. */
+    qatomic_set(&tb_tier_threshold, value);
+}
+
+static void tcg_get_spec_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->spec_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_spec_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TCG_MAX_SPEC_THREADS) {
+        error_setg(errp, "spec-threads must be at most %d",
+                   TCG_MAX_SPEC_THREADS);
+        return;
+    }
+    s->spec_threads = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -228,6 +310,18 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_evict_regions(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->evict_regions;
+}
+
+static void tcg_set_evict_regions(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->evict_regions = value;
+}
+
 static bool tcg_get_one_insn_per_tb(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -278,11 +372,29 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "tier-threshold", "uint32",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which a translation block is retranslated "
+        "as a superblock (0 disables tiering)");
+
+    object_class_property_add(oc, "spec-threads", "uint32",
+        tcg_get_spec_threads, tcg_set_spec_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "spec-threads",
+        "Threads translating code ahead of the vCPUs (thread=multi only)");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
 
+    object_class_property_add_bool(oc, "evict-regions",
+        tcg_get_evict_regions, tcg_set_evict_regions);
+    object_class_property_set_description(oc, "evict-regions",
+        "Evict cold code buffer regions instead of flushing all TBs");
+
     object_class_property_add_bool(oc, "one-insn-per-tb",
                                    tcg_get_one_insn_per_tb,
                                    tcg_set_one_insn_per_tb);
@@ -8,6 +8,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/accel.h"
+#include "qemu/units.h"
 #include "qemu/qht.h"
 #include "qapi/error.h"
 #include "system/cpu-timers.h"
@@ -155,6 +156,19 @@ static void tcg_dump_flush_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "TB region evictions %u (%u TBs, %zu KiB)\n",
+                           qatomic_read(&tb_ctx.tb_evict_count),
+                           qatomic_read(&tb_ctx.tb_evict_tb_count),
+                           qatomic_read(&tb_ctx.tb_evict_size) / KiB);
+    g_string_append_printf(buf, "TB retranslations   %u (%zu KiB)\n",
+                           qatomic_read(&tb_ctx.tb_retranslate_count),
+                           qatomic_read(&tb_ctx.tb_retranslate_size) / KiB);
+    g_string_append_printf(buf, "TB tier-ups         %u (%u jumps followed)\n",
+                           qatomic_read(&tb_ctx.tb_tier_up_count),
+                           qatomic_read(&tb_ctx.tb_trace_follow_count));
+    g_string_append_printf(buf, "TB translated ahead %u (%u requests dropped)\n",
+                           qatomic_read(&tb_ctx.tb_spec_count),
+                           qatomic_read(&tb_ctx.tb_spec_drop_count));
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
@@ -257,15 +257,92 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
+/*
+ * Tiered translation: with tb_tier_threshold set, TBs are first
+ * translated with an execution counter and retranslated by
+ * tb_tier_up() once hot.  Counted TBs must be able to leave before
+ * their first insn and be replaced; the exact-count and debug TBs
+ * below are short-lived or run once, so leave them alone.
+ */
+static uint8_t tb_initial_tier(TCGTBCPUState s, tb_page_addr_t phys_pc)
+{
+    if (!qatomic_read(&tb_tier_threshold) || phys_pc == -1) {
+        return TB_TIER_NONE;
+    }
+    if (s.cflags & (CF_COUNT_MASK | CF_NO_GOTO_TB | CF_SINGLE_STEP |
+                    CF_BP_PAGE | CF_USE_ICOUNT | CF_NOIRQ)) {
+        return TB_TIER_NONE;
+    }
+    return TB_TIER_BASE;
+}
+
+static TranslationBlock *tb_gen_code_tier(CPUState *cpu, TCGTBCPUState s,
+                                          int tier);
+static TranslationBlock *tb_gen_code_at(CPUState *cpu, TCGTBCPUState s,
+                                        int tier, tb_page_addr_t phys_pc,
+                                        void *host_pc);
+
 /* Called with mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
+{
+    return tb_gen_code_tier(cpu, s, -1);
+}
+
+/*
+ * Retranslate @tb, which has become hot, as a second-tier TB: the
+ * translator follows unconditional direct jumps into it (see
+ * translator_follow_jump()), so that the optimizer and liveness pass
+ * work on the whole trace at once, propagating constants across the
+ * former block boundaries and dropping the guest register spills
+ * between them.  The new TB replaces @tb in the hash table; callers
+ * chain to it again through tb_add_jump() as they run into it.
+ *
+ * Only one vCPU does the work; the others keep running @tb until it
+ * is invalidated, and then pick up the new one from the hash table.
+ * Called without mmap_lock held.
+ */
+TranslationBlock *tb_tier_up(CPUState *cpu, TranslationBlock *tb,
+                             TCGTBCPUState s)
+{
+    TranslationBlock *new_tb;
+
+    if (qatomic_cmpxchg(&tb->tier, TB_TIER_BASE, TB_TIER_NONE)
+        != TB_TIER_BASE) {
+        return tb;
+    }
+
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    new_tb = tb_gen_code_tier(cpu, s, TB_TIER_TRACE);
+    mmap_unlock();
+
+    qatomic_inc(&tb_ctx.tb_tier_up_count);
+    return new_tb;
+}
+
+/*
+ * Translate the block at @s.pc, which is at @phys_pc in RAM and mapped
+ * at @host_pc, before @cpu runs into it.  Called on the helper threads
+ * of tb-spec.c, with the RCU read lock held.  Returns NULL if the block
+ * could not be translated without the help of the vCPU thread.
+ */
+TranslationBlock *tb_gen_code_ahead(CPUState *cpu, TCGTBCPUState s,
+                                    tb_page_addr_t phys_pc, void *host_pc)
+{
+    assert(tcg_ctx->speculative);
+    return tb_gen_code_at(cpu, s, -1, phys_pc, host_pc);
+}
+
+/*
+ * Called with mmap_lock held for user mode emulation.
+ * A negative @tier picks the initial tier.
+ */
+static TranslationBlock *tb_gen_code_tier(CPUState *cpu, TCGTBCPUState s,
+                                          int tier)
 {
     CPUArchState *env = cpu_env(cpu);
-    TranslationBlock *tb, *existing_tb;
-    tb_page_addr_t phys_pc, phys_p2;
-    tcg_insn_unit *gen_code_buf;
-    int gen_code_size, search_size, max_insns;
-    int64_t ti;
+    TranslationBlock *tb;
+    tb_page_addr_t phys_pc;
     void *host_pc;
 
     assert_memory_lock();
@@ -278,17 +355,54 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         s.cflags = (s.cflags & ~CF_COUNT_MASK) | 1;
     }
 
+    /* A translation saved by an earlier run saves translating again. */
+    if (tier < 0 && phys_pc != -1) {
+        tb = tb_cache_lookup(s, phys_pc);
+        if (tb) {
+            return tb;
+        }
+    }
+
+    tb = tb_gen_code_at(cpu, s, tier, phys_pc, host_pc);
+    if (tb_page_addr0(tb) != -1) {
+        tb_spec_request(cpu, s, tb, host_pc);
+    }
+    return tb;
+}
+
+/* Translate and link the block at @s.pc, found at @phys_pc and @host_pc. */
+static TranslationBlock *tb_gen_code_at(CPUState *cpu, TCGTBCPUState s,
+                                        int tier, tb_page_addr_t phys_pc,
+                                        void *host_pc)
+{
+    CPUArchState *env = cpu_env(cpu);
+    TranslationBlock *tb, *existing_tb;
+    tb_page_addr_t phys_p2;
+    tcg_insn_unit *gen_code_buf;
+    int gen_code_size, search_size, max_insns;
+    int64_t ti;
+
+    qemu_thread_jit_write();
+
     max_insns = s.cflags & CF_COUNT_MASK;
     if (max_insns == 0) {
         max_insns = TCG_MAX_INSNS;
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
 
+    /* Make room before the buffer fills up and needs a full flush.  */
+    if (unlikely(tcg_region_evict_wanted())) {
+        tb_evict_cold_region();
+    }
+
  buffer_overflow:
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
+        /* flush must be done, but not by translating ahead */
+        if (tcg_ctx->speculative) {
+            return NULL;
+        }
         if (cpu_in_serial_context(cpu)) {
             tb_flush__exclusive_or_serial();
             goto buffer_overflow;
@@ -308,6 +422,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     tb->cs_base = s.cs_base;
     tb->flags = s.flags;
     tb->cflags = s.cflags;
+    tb->tier = tier < 0 ? tb_initial_tier(s, phys_pc) : tier;
+    tb->hotness = qatomic_read(&tb_tier_threshold);
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -381,6 +497,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
                           "Restarting code generation with re-locked pages");
             goto restart_translate;
 
+        case -4:
+            /*
+             * Translating ahead, we reached a second page, whose address
+             * only the vCPU can look up.  Let it translate the block.
+             */
+            tb_unlock_pages(tb);
+            tcg_ctx->gen_tb = NULL;
+            qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
+                        ((uintptr_t)gen_code_buf -
+                         ROUND_UP(sizeof(*tb), qemu_icache_linesize)));
+            return NULL;
+
         default:
             g_assert_not_reached();
         }
@@ -20,6 +20,7 @@
 #include "internal-common.h"
 #include "disas/disas.h"
 #include "tb-internal.h"
+#include "tb-context.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
 {
@@ -82,6 +83,25 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
                          sizeof(CPUState));
     }
 
+    /*
+     * Count executions of a first-tier TB, and leave before running
+     * any of it on the one that makes it hot.  The count is not atomic:
+     * a lost decrement from a racing vCPU only delays the tier-up, and
+     * racing decrements may take it below zero, hence the signed test.
+     */
+    if (db->tb->tier == TB_TIER_BASE) {
+        TCGv_ptr tb_ptr = tcg_constant_ptr(db->tb);
+        TCGv_i32 hot = tcg_temp_new_i32();
+
+        tcg_gen_ld_i32(hot, tb_ptr, offsetof(TranslationBlock, hotness));
+        tcg_gen_subi_i32(hot, hot, 1);
+        tcg_gen_st_i32(hot, tb_ptr, offsetof(TranslationBlock, hotness));
+        tcg_ctx->hot_label = gen_new_label();
+        tcg_gen_brcondi_i32(TCG_COND_LE, hot, 0, tcg_ctx->hot_label);
+    } else {
+        tcg_ctx->hot_label = NULL;
+    }
+
     return icount_start_insn;
 }
 
@@ -101,6 +121,10 @@ static void gen_tb_end(const TranslationBlock *tb, uint32_t cflags,
         gen_set_label(tcg_ctx->exitreq_label);
         tcg_gen_exit_tb(tb, TB_EXIT_REQUESTED);
     }
+    if (tcg_ctx->hot_label) {
+        gen_set_label(tcg_ctx->hot_label);
+        tcg_gen_exit_tb(tb, TB_EXIT_HOT);
+    }
 }
 
 bool translator_is_same_page(const DisasContextBase *db, vaddr addr)
@@ -116,7 +140,50 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return translator_is_same_page(db, dest);
+    if (!translator_is_same_page(db, dest)) {
+        return false;
+    }
+
+    /* Remember it, for tb-spec.c to translate before it is reached. */
+    if (!db->plugin_enabled && tcg_ctx->gen_nb_jmp_dest < 2 &&
+        (tcg_ctx->gen_nb_jmp_dest == 0 || tcg_ctx->gen_jmp_dest[0] != dest)) {
+        tcg_ctx->gen_jmp_dest[tcg_ctx->gen_nb_jmp_dest++] = dest;
+    }
+    return true;
+}
+
+/* Direct jumps followed into one second-tier TB. */
+#define TB_TRACE_MAX_FOLLOW  8
+
+bool translator_follow_jump(DisasContextBase *db, vaddr dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    if (db->tb->tier != TB_TIER_TRACE || db->plugin_enabled ||
+        tb_page_addr0(db->tb) == -1) {
+        return false;
+    }
+    if (cflags & (CF_NO_GOTO_TB | CF_SINGLE_STEP | CF_BP_PAGE |
+                  CF_USE_ICOUNT)) {
+        return false;
+    }
+    if (db->num_follow >= TB_TRACE_MAX_FOLLOW) {
+        return false;
+    }
+    /*
+     * Backward jumps would leave the bytes after the jump uncovered by
+     * [pc_first, pc_first + size), and with them self-modifying code
+     * detection; they are also what closes a loop, which must still
+     * come back to the main loop to take interrupts.
+     */
+    if (dest < db->pc_next || !translator_is_same_page(db, dest)) {
+        return false;
+    }
+
+    db->num_follow++;
+    db->pc_next = dest;
+    qatomic_inc(&tb_ctx.tb_trace_follow_count);
+    return true;
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
@@ -135,6 +202,8 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
     db->max_insns = *max_insns;
+    db->num_follow = 0;
+    tcg_ctx->gen_nb_jmp_dest = 0;
     db->insn_start = NULL;
     db->fake_insn = false;
     db->host_addr[0] = host_pc;
@@ -298,6 +367,14 @@ static bool translator_ld(CPUArchState *env, DisasContextBase *db,
     if (host == NULL) {
         tb_page_addr_t page0, old_page1, new_page1;
 
+        /*
+         * Only the vCPU thread may walk its TLB; when translating
+         * ahead, give up on blocks that reach into a second page.
+         */
+        if (tcg_ctx->speculative) {
+            siglongjmp(tcg_ctx->jmp_trans, -4);
+        }
+
         new_page1 = get_page_addr_code_hostp(env, base, &db->host_addr[1]);
 
         /*
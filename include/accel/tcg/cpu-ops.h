@@ -36,6 +36,14 @@ struct TCGCPUOps {
      */
     bool precise_smc;
 
+    /**
+     * @translate_from_tb_flags: @translate_code depends only on the TB's
+     * pc, cs_base, flags and cflags and on the CPU model, never on the
+     * current CPU state.  TBs can then be translated ahead of use on
+     * other threads, see accel/tcg/tb-spec.c.
+     */
+    bool translate_from_tb_flags;
+
     /**
      * @guest_default_memory_order: default barrier that is required
      *                              for the guest memory ordering.
@@ -0,0 +1,38 @@
+/*
+ * Persistent translation cache for user-mode emulation.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+/**
+ * tb_cache_load:
+ * @dir: directory holding the cache files
+ * @exec_path: full path of the guest executable
+ * @cpu_model: the -cpu option in effect, or NULL
+ *
+ * Load the translations saved by an earlier run of @exec_path into
+ * code_gen_buffer.  Each one is used the first time its TB is looked
+ * up, if the guest pages it was translated from still hold the same
+ * bytes; until then it costs nothing but buffer space.
+ *
+ * Must be called after tcg_prologue_init() and before any code is
+ * translated.  Translated code embeds host addresses, so the cache
+ * only matches when QEMU and code_gen_buffer are mapped where they
+ * were when it was saved, i.e. with address space randomization off.
+ */
+void tb_cache_load(const char *dir, const char *exec_path,
+                   const char *cpu_model);
+
+/**
+ * tb_cache_save:
+ *
+ * Write the translations currently in code_gen_buffer, together with
+ * those loaded by tb_cache_load() and not used yet, back to the cache
+ * file.  Does nothing if tb_cache_load() was not called or nothing new
+ * was translated.
+ */
+void tb_cache_save(void);
+
+#endif
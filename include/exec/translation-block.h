@@ -92,6 +92,18 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Translation tier, see tb_tier_up().  A first-tier TB built while
+     * tiering is enabled counts its executions down in @hotness and
+     * exits with TB_EXIT_HOT when that reaches zero.  Neither field is
+     * part of the lookup key: the second-tier TB replaces the first.
+     */
+#define TB_TIER_NONE    0
+#define TB_TIER_BASE    1
+#define TB_TIER_TRACE   2
+    uint8_t tier;
+    int32_t hotness;
+
     struct tb_tc tc;
 
     /*
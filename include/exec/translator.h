@@ -57,6 +57,7 @@ typedef enum DisasJumpType {
  * @is_jmp: What instruction to disassemble next.
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
+ * @num_follow: Number of direct jumps followed by translator_follow_jump().
  * @plugin_enabled: TCG plugin enabled in this TB.
  * @fake_insn: True if translator_fake_ldb used.
  * @insn_start: The last op emitted by the insn_start hook,
@@ -71,6 +72,7 @@ struct DisasContextBase {
     DisasJumpType is_jmp;
     int num_insns;
     int max_insns;
+    int num_follow;
     bool plugin_enabled;
     bool fake_insn;
     uint8_t code_mmuidx;
@@ -159,6 +161,22 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation of a second-tier TB may continue at @dest
+ * instead of ending with a goto_tb, merging the successor block into
+ * this one.  On success, db->pc_next is set to @dest and the target must
+ * emit nothing for the jump beyond what keeps its own state in sync.
+ *
+ * Only forward jumps within the first page are followed, so that
+ * tb->size still spans every guest byte the TB was translated from.
+ * So far only x86-64 JMP rel, and CALL rel through it, calls this.
+ */
+bool translator_follow_jump(DisasContextBase *db, vaddr dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
@@ -402,6 +402,13 @@ struct TCGContext {
     struct TCGLabelPoolData *pool_labels;
 
     TCGLabel *exitreq_label;
+    TCGLabel *hot_label;
+
+    /* Same-page goto_tb destinations of gen_tb, to translate ahead.  */
+    uint64_t gen_jmp_dest[2];
+    int gen_nb_jmp_dest;
+    /* This thread translates ahead of the vCPUs, see tb-spec.c.  */
+    bool speculative;
 
 #ifdef CONFIG_PLUGIN
     /*
@@ -422,6 +429,10 @@ struct TCGContext {
 #ifdef __riscv
     MemOp riscv_cur_vsew;
     TCGType riscv_cur_type;
+#endif
+#ifdef CONFIG_TCG_INTERPRETER
+    /* The last insn emitted, if it may start a superinstruction. */
+    tcg_insn_unit *tci_fuse_ptr;
 #endif
     /*
      * During the tcg_reg_alloc_op loop, we are within a sequence of
@@ -652,6 +663,31 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
 
+/**
+ * TCGRegionEviction:
+ * @index: the region being evicted
+ * @resets: tcg_region_reset_all() calls seen when eviction started
+ * @size: bytes of translated code in the region
+ * @start: first byte of the region
+ * @end: first byte past the region
+ *
+ * A region of code_gen_buffer on its way from full to free again.
+ */
+typedef struct TCGRegionEviction {
+    size_t index;
+    unsigned resets;
+    size_t size;
+    void *start;
+    void *end;
+} TCGRegionEviction;
+
+void tcg_region_touch(const void *tc_ptr);
+bool tcg_region_evict_wanted(void);
+bool tcg_region_evict_begin(TCGRegionEviction *ev);
+void tcg_region_evict_foreach(TCGRegionEviction *ev, GTraverseFunc func,
+                              gpointer user_data);
+void tcg_region_evict_end(TCGRegionEviction *ev);
+
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
 
@@ -934,11 +970,9 @@ static inline size_t tcg_current_code_size(TCGContext *s)
  *        TB index (0 or 1). That is, we left the TB via (the equivalent
  *        of) "goto_tb <index>". The main loop uses this to determine
  *        how to link the TB just executed to the next.
- *  2:    we are using instruction counting code generation, and we
- *        did not start executing this TB because the instruction counter
- *        would hit zero midway through it. In this case the pointer
- *        returned is the TB we were about to execute, and the caller must
- *        arrange to execute the remaining count of instructions.
+ *  2:    this first-tier TB has run often enough to be retranslated
+ *        as a superblock (see tb_tier_up()).  The pointer returned is
+ *        the TB we were about to execute; none of it has run.
  *  3:    we stopped because the CPU's exit_request flag was set
  *        (usually meaning that there is an interrupt that needs to be
  *        handled). The pointer returned is the TB we were about to execute
@@ -961,6 +995,7 @@ static inline size_t tcg_current_code_size(TCGContext *s)
 #define TB_EXIT_IDX0      0
 #define TB_EXIT_IDX1      1
 #define TB_EXIT_IDXMAX    1
+#define TB_EXIT_HOT       2
 #define TB_EXIT_REQUESTED 3
 
 #ifdef CONFIG_TCG_INTERPRETER
@@ -25,6 +25,7 @@
 #include <sys/syscall.h>
 #include <sys/resource.h>
 #include <sys/shm.h>
+#include <sys/personality.h>
 #include <linux/binfmts.h>
 
 #include "qapi/error.h"
@@ -56,6 +57,7 @@
 #include "loader.h"
 #include "user-mmap.h"
 #include "tcg/perf.h"
+#include "accel/tcg/tb-cache.h"
 #include "exec/page-vary.h"
 
 #ifdef CONFIG_SEMIHOSTING
@@ -72,6 +74,8 @@ char real_exec_path[PATH_MAX];
 
 static bool opt_one_insn_per_tb;
 static unsigned long opt_tb_size;
+static unsigned long opt_tb_tier;
+static const char *opt_tb_cache;
 static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
@@ -422,6 +426,18 @@ static void handle_arg_tb_size(const char *arg)
     }
 }
 
+static void handle_arg_tb_tier(const char *arg)
+{
+    if (qemu_strtoul(arg, NULL, 0, &opt_tb_tier) || opt_tb_tier > INT32_MAX) {
+        usage(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_tb_cache(const char *arg)
+{
+    opt_tb_cache = arg;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -514,6 +530,10 @@ static const struct qemu_argument arg_table[] = {
      "",           "run with one guest instruction per emulated TB"},
     {"tb-size",    "QEMU_TB_SIZE",     true,  handle_arg_tb_size,
      "size",       "TCG translation block cache size"},
+    {"tb-tier",    "QEMU_TB_TIER",     true,  handle_arg_tb_tier,
+     "count",      "retranslate TBs run this often as superblocks"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translations in dir for the next run"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
@@ -679,6 +699,59 @@ static int parse_args(int argc, char **argv)
     return optind;
 }
 
+#define TB_CACHE_PERSONA_ENV "QEMU_TB_CACHE_PERSONA"
+
+/*
+ * Translated code embeds host addresses, so -tb-cache only finds its
+ * translations again if QEMU and the guest are mapped at the same
+ * addresses on every run.  Restart ourselves without randomization,
+ * unless binfmt_misc handed us state that does not survive an exec.
+ *
+ * The layout of a process is chosen when it is exec'd, so after the
+ * restart the old personality is put back: only this process runs
+ * without randomization, not the programs the guest goes on to run.
+ */
+static void tb_cache_disable_aslr(char **argv)
+{
+    const char *saved = getenv(TB_CACHE_PERSONA_ENV);
+    g_autofree char *val = NULL;
+    int persona;
+
+    if (saved) {
+        if (qemu_strtoi(saved, NULL, 10, &persona) == 0) {
+            personality(persona);
+        }
+        unsetenv(TB_CACHE_PERSONA_ENV);
+        envlist_unsetenv(envlist, TB_CACHE_PERSONA_ENV);
+        return;
+    }
+
+    persona = personality(0xffffffff);
+    if (persona < 0 || (persona & ADDR_NO_RANDOMIZE)) {
+        return;
+    }
+    if (qemu_getauxval(AT_SECURE) ||
+        (qemu_getauxval(AT_FLAGS) & AT_FLAGS_PRESERVE_ARGV0)) {
+        return;
+    }
+    errno = 0;
+    qemu_getauxval(AT_EXECFD);
+    if (errno == 0) {
+        return;
+    }
+
+    if (personality(persona | ADDR_NO_RANDOMIZE) < 0) {
+        return;
+    }
+    val = g_strdup_printf("%d", persona);
+    setenv(TB_CACHE_PERSONA_ENV, val, 1);
+    execv("/proc/self/exe", argv);
+    warn_report("-tb-cache: cannot restart without randomization: %s",
+                strerror(errno));
+    unsetenv(TB_CACHE_PERSONA_ENV);
+    personality(persona);
+}
+
 int main(int argc, char **argv, char **envp)
 {
     struct image_info info1, *info = &info1;
@@ -736,6 +809,10 @@ int main(int argc, char **argv, char **envp)
 
     optind = parse_args(argc, argv);
 
+    if (opt_tb_cache) {
+        tb_cache_disable_aslr(argv);
+    }
+
     qemu_set_log_filename_flags(last_log_filename,
                                 last_log_mask | (enable_strace * LOG_STRACE),
                                 &error_fatal);
@@ -803,6 +880,8 @@ int main(int argc, char **argv, char **envp)
                                  opt_one_insn_per_tb, &error_abort);
         object_property_set_int(OBJECT(accel), "tb-size",
                                 opt_tb_size, &error_abort);
+        object_property_set_uint(OBJECT(accel), "tier-threshold",
+                                 opt_tb_tier, &error_abort);
         ac->init_machine(accel, NULL);
     }
 
@@ -1024,6 +1103,14 @@ int main(int argc, char **argv, char **envp)
 
     init_main_thread(cpu, info);
 
+    if (opt_tb_cache) {
+        if (QTAILQ_EMPTY(&plugins)) {
+            tb_cache_load(opt_tb_cache, exec_path, cpu_model);
+        } else {
+            warn_report("-tb-cache is ignored when plugins are loaded");
+        }
+    }
+
     if (gdbstub) {
         gdbserver_start(gdbstub, &error_fatal);
     }
@@ -229,10 +229,13 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                select accelerator (kvm, xen, hvf, nvmm, whpx, mshv or tcg; use 'help' for a list)\n"
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
+    "                evict-regions=on|off (evict cold TCG code instead of flushing it all, default=off)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
+    "                spec-threads=n (TCG threads translating ahead of the vCPUs, default=0)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tier-threshold=n (retranslate hot TCG blocks as superblocks, default=0)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -246,6 +249,12 @@ SRST
     specified, the next one is used if the previous one fails to
     initialize.
 
+    ``evict-regions=on|off``
+        When the TCG translation block cache fills up, evict the least
+        recently used part of it instead of flushing all translated code.
+        This splits the cache into more regions, even with a single
+        vCPU thread. Only available in system emulation (default=off)
+
     ``igd-passthru=on|off``
         When Xen is in use, this option controls whether Intel
         integrated graphics devices can be passed through to the guest
@@ -267,6 +276,13 @@ SRST
         can be useful in some situations, such as when trying to analyse
         the logs produced by the ``-d`` option.
 
+    ``spec-threads=n``
+        Starts n threads that translate code for the vCPUs before they
+        need it: the blocks that newly translated blocks jump to on the
+        same page. Useful with ``thread=multi`` when the host has more
+        cores than the guest has vCPUs. Only supported by some targets.
+        The default is 0, which disables translating ahead.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -276,6 +292,15 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tier-threshold=n``
+        Retranslate a TCG translation block after it has run n times,
+        following the unconditional direct jumps out of it so that the
+        optimizer sees the resulting superblock as a whole. So far only
+        x86-64 ``JMP rel`` (and ``CALL rel``) jumps are followed, and only
+        forward ones within the block's first page; conditional branches
+        always end the block. On other targets it merely retranslates.
+        The default is 0, which disables tiered translation.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -114,17 +114,27 @@ static void x86_restore_state_to_opc(CPUState *cs,
     }
 }
 
-int x86_mmu_index_pl(CPUX86State *env, unsigned pl)
+/*
+ * The data MMU index for privilege level @pl, given the HF_CS64 and
+ * HF_SMAP bits of @hflags and the AC bit of @eflags.  TB flags carry
+ * all three, so translation can use this without the live state.
+ */
+int x86_mmu_index_flags(uint32_t hflags, uint32_t eflags, unsigned pl)
 {
-    int mmu_index_32 = (env->hflags & HF_CS64_MASK) ? 0 : 1;
+    int mmu_index_32 = (hflags & HF_CS64_MASK) ? 0 : 1;
     int mmu_index_base =
         pl == 3 ? MMU_USER64_IDX :
-        !(env->hflags & HF_SMAP_MASK) ? MMU_KNOSMAP64_IDX :
-        (env->eflags & AC_MASK) ? MMU_KNOSMAP64_IDX : MMU_KSMAP64_IDX;
+        !(hflags & HF_SMAP_MASK) ? MMU_KNOSMAP64_IDX :
+        (eflags & AC_MASK) ? MMU_KNOSMAP64_IDX : MMU_KSMAP64_IDX;
 
     return mmu_index_base + mmu_index_32;
 }
 
+int x86_mmu_index_pl(CPUX86State *env, unsigned pl)
+{
+    return x86_mmu_index_flags(env->hflags, env->eflags, pl);
+}
+
 static int x86_cpu_mmu_index(CPUState *cs, bool ifetch)
 {
     CPUX86State *env = cpu_env(cs);
@@ -160,6 +170,7 @@ static vaddr x86_pointer_wrap(CPUState *cs, int mmu_idx,
 const TCGCPUOps x86_tcg_ops = {
     .mttcg_supported = true,
     .precise_smc = true,
+    .translate_from_tb_flags = true,
     /*
      * The x86 has a strong memory model with some store-after-load re-ordering
      */
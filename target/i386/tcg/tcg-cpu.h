@@ -82,6 +82,7 @@ extern const TCGCPUOps x86_tcg_ops;
 
 bool tcg_cpu_realizefn(CPUState *cs, Error **errp);
 
+int x86_mmu_index_flags(uint32_t hflags, uint32_t eflags, unsigned pl);
 int x86_mmu_index_pl(CPUX86State *env, unsigned pl);
 
 #endif /* TCG_CPU_H */
@@ -20,7 +20,6 @@
 
 #include "qemu/host-utils.h"
 #include "cpu.h"
-#include "accel/tcg/cpu-mmu-index.h"
 #include "exec/translation-block.h"
 #include "tcg/tcg-op.h"
 #include "tcg/tcg-op-gvec.h"
@@ -31,6 +30,7 @@
 #include "exec/helper-proto.h"
 #include "exec/helper-gen.h"
 #include "helper-tcg.h"
+#include "tcg-cpu.h"
 #include "decode-new.h"
 
 #include "exec/log.h"
@@ -2379,6 +2379,27 @@ static void gen_jmp_rel(DisasContext *s, MemOp ot, int diff, int tb_num)
     }
 }
 
+/*
+ * For an unconditional jump to eip+diff, try to continue translating
+ * at the target instead, as part of a second-tier TB.  Only done in
+ * 64-bit mode, where the target needs no truncation.
+ */
+static bool gen_follow_jmp(DisasContext *s, int diff)
+{
+    target_ulong new_pc = s->pc + diff;
+
+    assert(!s->cc_op_dirty);
+    if (!CODE64(s) || !s->jmp_opt || diff < 0) {
+        return false;
+    }
+    if (!translator_follow_jump(&s->base, new_pc)) {
+        return false;
+    }
+    /* With CF_PCREL, cpu_eip still matches pc_save; nothing to emit. */
+    s->pc = new_pc;
+    return true;
+}
+
 /* Jump to eip+diff, truncating to the current code size. */
 static void gen_jmp_rel_csize(DisasContext *s, int diff, int tb_num)
 {
@@ -3779,7 +3800,8 @@ static void i386_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cpu)
     dc->cc_op = CC_OP_DYNAMIC;
     dc->cc_op_dirty = false;
     /* select memory access functions */
-    dc->mem_index = cpu_mmu_index(cpu, false);
+    /* The TB flags hold the hflags and the eflags.AC bit needed. */
+    dc->mem_index = x86_mmu_index_flags(flags, flags, flags & HF_CPL_MASK);
     dc->cpuid_features = env->features[FEAT_1_EDX];
     dc->cpuid_ext_features = env->features[FEAT_1_ECX];
     dc->cpuid_ext2_features = env->features[FEAT_8000_0001_EDX];
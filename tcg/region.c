@@ -46,17 +46,47 @@
 #define PROT_EXEC   4
 #endif
 
+/*
+ * Eviction needs enough regions that one of them can be spared while
+ * every TCG thread is filling its own.
+ */
+#define TCG_REGION_MIN_EVICT 8
+
 struct tcg_region_tree {
     QemuMutex lock;
     QTree *tree;
     /* padding to avoid false sharing is computed at run-time */
 };
 
+/*
+ * What a region is being used for.  A region filled up by a TCG thread
+ * stays FULL until it is picked for eviction; it then waits in EVICTING
+ * for an RCU grace period, so that no vCPU can still be running code
+ * from it, before it is FREE to be allocated again.
+ */
+enum tcg_region_use {
+    TCG_REGION_FREE,
+    TCG_REGION_ACTIVE,
+    TCG_REGION_FULL,
+    TCG_REGION_EVICTING,
+};
+
+struct tcg_region_info {
+    enum tcg_region_use use;
+    bool referenced; /* a TB in it was looked up since the last eviction */
+    uint64_t gen; /* when it filled up, or last got a second chance */
+    size_t size_full; /* its share of agg_size_full */
+};
+
 /*
  * We divide code_gen_buffer into equally-sized "regions" that TCG threads
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * With -accel tcg,evict-regions=on, once fewer than evict_low regions are
+ * free, the coldest full region is evicted (see tcg_region_evict_begin),
+ * so that the buffer normally never runs out and needs a full tb_flush.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -69,9 +99,16 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
 
+    size_t evict_low; /* keep at least this many regions free */
+
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    size_t current; /* where to look for a free region next */
     size_t agg_size_full; /* aggregate size of full regions */
+    struct tcg_region_info *info; /* one per region */
+    size_t n_free; /* regions in TCG_REGION_FREE */
+    uint64_t gen; /* counts regions filling up */
+    unsigned resets; /* counts tcg_region_reset_all calls */
+    bool evict_wanted; /* also read without the lock */
 };
 
 static struct tcg_region_state region;
@@ -191,10 +228,9 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region holding @p, or -1 if there is none. */
+static ssize_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -202,20 +238,28 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return -1;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    ssize_t region_idx = tc_ptr_to_region_idx(p);
+
+    if (region_idx < 0) {
+        return NULL;
     }
     return region_trees + region_idx * tree_size;
 }
@@ -326,6 +370,16 @@ static void tcg_region_tree_reset_all(void)
     tcg_region_tree_unlock_all();
 }
 
+static void tcg_region_tree_reset(size_t curr_region)
+{
+    struct tcg_region_tree *rt = region_trees + curr_region * tree_size;
+
+    qemu_mutex_lock(&rt->lock);
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+}
+
 static void tcg_region_bounds(size_t curr_region, void **pstart, void **pend)
 {
     void *start, *end;
@@ -359,11 +413,18 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    if (region.n_free == 0) {
         return true;
     }
+    while (region.info[region.current].use != TCG_REGION_FREE) {
+        region.current = (region.current + 1) % region.n;
+    }
     tcg_region_assign(s, region.current);
-    region.current++;
+    region.info[region.current].use = TCG_REGION_ACTIVE;
+    region.n_free--;
+    if (region.n_free < region.evict_low) {
+        qatomic_set(&region.evict_wanted, true);
+    }
     return false;
 }
 
@@ -374,13 +435,22 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /* read the region now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    ssize_t full = tc_ptr_to_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
-        region.agg_size_full += size_full - TCG_HIGHWATER;
+        struct tcg_region_info *info;
+
+        g_assert(full >= 0);
+        info = &region.info[full];
+
+        info->use = TCG_REGION_FULL;
+        info->gen = region.gen++;
+        info->size_full = size_full - TCG_HIGHWATER;
+        region.agg_size_full += info->size_full;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -412,6 +482,10 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    memset(region.info, 0, region.n * sizeof(*region.info));
+    region.n_free = region.n;
+    region.resets++;
+    qatomic_set(&region.evict_wanted, false);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,7 +496,130 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
-static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
+/*
+ * Note that a TB of the region holding @tc_ptr was looked up, so that
+ * the region gets a second chance before it is evicted.
+ */
+void tcg_region_touch(const void *tc_ptr)
+{
+    ssize_t i = tc_ptr_to_region_idx(tc_ptr);
+
+    /* Avoid dirtying the cache line when the flag is already set. */
+    if (i >= 0 && !qatomic_read(&region.info[i].referenced)) {
+        qatomic_set(&region.info[i].referenced, true);
+    }
+}
+
+bool tcg_region_evict_wanted(void)
+{
+    return qatomic_read(&region.evict_wanted);
+}
+
+/*
+ * Choose the region to evict: the full region that filled up longest
+ * ago among those with no TB looked up since the last eviction.
+ * Referenced regions passed over on the way get a second chance, i.e.
+ * count as newly filled from now on.  Returns -1 if no region is full.
+ */
+static ssize_t tcg_region_pick_victim__locked(void)
+{
+    ssize_t victim = -1, oldest = -1;
+    size_t i;
+
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_info *info = &region.info[i];
+
+        if (info->use != TCG_REGION_FULL) {
+            continue;
+        }
+        if (oldest < 0 || info->gen < region.info[oldest].gen) {
+            oldest = i;
+        }
+        if (!qatomic_read(&info->referenced) &&
+            (victim < 0 || info->gen < region.info[victim].gen)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        /* Everything is referenced; fall back to plain FIFO. */
+        victim = oldest;
+    }
+    if (victim < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < region.n; i++) {
+        struct tcg_region_info *info = &region.info[i];
+
+        if (info->use == TCG_REGION_FULL && qatomic_read(&info->referenced) &&
+            info->gen < region.info[victim].gen) {
+            qatomic_set(&info->referenced, false);
+            info->gen = region.gen++;
+        }
+    }
+    return victim;
+}
+
+/*
+ * Start evicting the coldest full region.  The caller must invalidate
+ * every TB that tcg_region_evict_foreach() finds in it, and then, after
+ * an RCU grace period, call tcg_region_evict_end() to make the region
+ * available for allocation again.
+ * Returns false if there is no region to evict.
+ */
+bool tcg_region_evict_begin(TCGRegionEviction *ev)
+{
+    ssize_t victim;
+
+    qemu_mutex_lock(&region.lock);
+    qatomic_set(&region.evict_wanted, false);
+    victim = tcg_region_pick_victim__locked();
+    if (victim < 0) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+    region.info[victim].use = TCG_REGION_EVICTING;
+    ev->index = victim;
+    ev->resets = region.resets;
+    ev->size = region.info[victim].size_full;
+    tcg_region_bounds(victim, &ev->start, &ev->end);
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
+void tcg_region_evict_foreach(TCGRegionEviction *ev, GTraverseFunc func,
+                              gpointer user_data)
+{
+    struct tcg_region_tree *rt = region_trees + ev->index * tree_size;
+
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, func, user_data);
+    qemu_mutex_unlock(&rt->lock);
+}
+
+/*
+ * Finish evicting the region of @ev.  Nothing must be able to reach
+ * its TBs any more.  If the whole buffer was reset in the meantime,
+ * the region may already be in use again and is left alone.
+ */
+void tcg_region_evict_end(TCGRegionEviction *ev)
+{
+    struct tcg_region_info *info = &region.info[ev->index];
+
+    qemu_mutex_lock(&region.lock);
+    if (ev->resets == region.resets) {
+        g_assert(info->use == TCG_REGION_EVICTING);
+        tcg_region_tree_reset(ev->index);
+        region.agg_size_full -= info->size_full;
+        info->size_full = 0;
+        qatomic_set(&info->referenced, false);
+        info->use = TCG_REGION_FREE;
+        region.n_free++;
+    }
+    qemu_mutex_unlock(&region.lock);
+}
+
+static size_t tcg_n_regions(size_t tb_size, unsigned max_threads, bool evict)
 {
 #ifdef CONFIG_USER_ONLY
     return 1;
@@ -435,9 +632,10 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      *
-     * Use a single region if all we have is one vCPU thread.
+     * With eviction, even a single vCPU thread gets several regions, so
+     * that evicting one throws away only part of the translated code.
      */
-    if (max_threads == 1) {
+    if (max_threads == 1 && !evict) {
         return 1;
     }
 
@@ -449,6 +647,9 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
     if (n_regions <= max_threads) {
         return max_threads;
     }
+    if (evict) {
+        return MIN(n_regions, MAX(max_threads * 8, TCG_REGION_MIN_EVICT * 2));
+    }
     return MIN(n_regions, max_threads * 8);
 #endif
 }
@@ -746,7 +947,8 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in system-mode
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads,
+                     bool evict)
 {
     const size_t page_size = qemu_real_host_page_size();
     size_t region_size;
@@ -784,7 +986,7 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_threads);
+    region.n = tcg_n_regions(tb_size, max_threads, evict);
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
@@ -805,6 +1007,16 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.info = g_new0(struct tcg_region_info, region.n);
+    region.n_free = region.n;
+    /*
+     * Evict before running out, since a region can only be reused an
+     * RCU grace period after its eviction started.  Without eviction,
+     * or with too few regions to spare one, only a full flush is possible.
+     */
+    if (evict && region.n >= TCG_REGION_MIN_EVICT) {
+        region.evict_low = MAX(region.n / 8, 1);
+    }
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
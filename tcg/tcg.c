@@ -361,6 +361,10 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l)
     tcg_debug_assert(!l->has_value);
     l->has_value = 1;
     l->u.value_ptr = tcg_splitwx_to_rx(s->code_ptr);
+#ifdef CONFIG_TCG_INTERPRETER
+    /* A branch may land here: never fuse across the label. */
+    s->tci_fuse_ptr = NULL;
+#endif
 }
 
 TCGLabel *gen_new_label(void)
@@ -1856,10 +1860,10 @@ static void tcg_context_init(unsigned max_threads)
     tcg_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_threads)
+void tcg_init(size_t tb_size, int splitwx, unsigned max_threads, bool evict)
 {
     tcg_context_init(max_threads);
-    tcg_region_init(tb_size, splitwx, max_threads);
+    tcg_region_init(tb_size, splitwx, max_threads, evict);
 }
 
 /*
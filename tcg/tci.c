@@ -66,6 +66,7 @@ static uint64_t tci_uint64(uint32_t high, uint32_t low)
  *   i = immediate (uint32_t)
  *   I = immediate (tcg_target_ulong)
  *   l = label or pointer
+ *   L = label, in the following word
  *   m = immediate (MemOpIdx)
  *   n = immediate (call return length)
  *   r = register
@@ -149,6 +150,17 @@ static void tci_args_rrrc(uint32_t insn,
     *c3 = extract32(insn, 20, 4);
 }
 
+static void tci_args_rrcL(uint32_t insn, const uint32_t **tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    int32_t diff = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (void *)*tb_ptr + diff;
+}
+
 static void tci_args_rrrbb(uint32_t insn, TCGReg *r0, TCGReg *r1,
                            TCGReg *r2, uint8_t *i3, uint8_t *i4)
 {
@@ -334,499 +346,699 @@ static void tci_qemu_st(CPUArchState *env, uint64_t taddr, uint64_t val,
 uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                                             const void *v_tb_ptr)
 {
+/*
+ * Threaded dispatch: each handler fetches the next insn itself and
+ * jumps to the handler of its opcode, which gives the host one
+ * indirect branch per handler to predict instead of a single one.
+ */
+#define CASE(name)  do_##name
+#define TARGET(name)  [INDEX_op_##name] = &&do_##name
+#define NEXT()                                          \
+    do {                                                \
+        insn = *tb_ptr++;                               \
+        goto *dispatch[extract32(insn, 0, 8)];          \
+    } while (0)
+
+    static const void * const dispatch[256] = {
+        [0 ... 255] = &&do_illegal,
+        TARGET(call),
+        TARGET(br),
+#if TCG_TARGET_REG_BITS == 32
+        TARGET(setcond2_i32),
+#elif TCG_TARGET_REG_BITS == 64
+        TARGET(setcond),
+        TARGET(movcond),
+#endif
+        TARGET(mov),
+        TARGET(tci_movi),
+        TARGET(tci_movl),
+        TARGET(tci_setcarry),
+        TARGET(ld8u),
+        TARGET(ld8s),
+        TARGET(ld16u),
+        TARGET(ld16s),
+        TARGET(ld),
+        TARGET(st8),
+        TARGET(st16),
+        TARGET(st),
+        TARGET(add),
+        TARGET(sub),
+        TARGET(mul),
+        TARGET(and),
+        TARGET(or),
+        TARGET(xor),
+        TARGET(andc),
+        TARGET(orc),
+        TARGET(eqv),
+        TARGET(nand),
+        TARGET(nor),
+        TARGET(neg),
+        TARGET(not),
+        TARGET(ctpop),
+        TARGET(addco),
+        TARGET(addci),
+        TARGET(addcio),
+        TARGET(subbo),
+        TARGET(subbi),
+        TARGET(subbio),
+        TARGET(muls2),
+        TARGET(mulu2),
+        TARGET(tci_divs32),
+        TARGET(tci_divu32),
+        TARGET(tci_rems32),
+        TARGET(tci_remu32),
+        TARGET(tci_clz32),
+        TARGET(tci_ctz32),
+        TARGET(tci_setcond32),
+        TARGET(tci_movcond32),
+        TARGET(shl),
+        TARGET(shr),
+        TARGET(sar),
+        TARGET(tci_rotl32),
+        TARGET(tci_rotr32),
+        TARGET(deposit),
+        TARGET(extract),
+        TARGET(sextract),
+        TARGET(brcond),
+        TARGET(bswap16),
+        TARGET(bswap32),
+#if TCG_TARGET_REG_BITS == 64
+        TARGET(ld32u),
+        TARGET(ld32s),
+        TARGET(st32),
+        TARGET(divs),
+        TARGET(divu),
+        TARGET(rems),
+        TARGET(remu),
+        TARGET(clz),
+        TARGET(ctz),
+        TARGET(rotl),
+        TARGET(rotr),
+        TARGET(ext_i32_i64),
+        TARGET(extu_i32_i64),
+        TARGET(bswap64),
+#endif /* TCG_TARGET_REG_BITS == 64 */
+        TARGET(tci_brcond32),
+#if TCG_TARGET_REG_BITS == 64
+        TARGET(tci_brcond),
+#endif
+        TARGET(tci_ld_add),
+        TARGET(tci_ld_sub),
+        TARGET(tci_ld_and),
+        TARGET(tci_ld_or),
+        TARGET(tci_ld_xor),
+        TARGET(tci_add_st),
+        TARGET(tci_sub_st),
+        TARGET(tci_and_st),
+        TARGET(tci_or_st),
+        TARGET(tci_xor_st),
+        TARGET(exit_tb),
+        TARGET(goto_tb),
+        TARGET(goto_ptr),
+        TARGET(qemu_ld),
+        TARGET(qemu_st),
+        TARGET(qemu_ld2),
+        TARGET(qemu_st2),
+        TARGET(mb),
+    };
     const uint32_t *tb_ptr = v_tb_ptr;
     tcg_target_ulong regs[TCG_TARGET_NB_REGS];
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
     bool carry = false;
+    uint32_t insn;
+    TCGReg r0, r1, r2, r3, r4;
+    tcg_target_ulong t1;
+    TCGCond condition;
+    uint8_t pos, len;
+    uint32_t tmp32;
+    uint64_t tmp64, taddr;
+    MemOpIdx oi;
+    int32_t ofs;
+    void *ptr;
 
     regs[TCG_AREG0] = (tcg_target_ulong)env;
     regs[TCG_REG_CALL_STACK] = (uintptr_t)stack;
     tci_assert(tb_ptr);
 
-    for (;;) {
-        uint32_t insn;
-        TCGOpcode opc;
-        TCGReg r0, r1, r2, r3, r4;
-        tcg_target_ulong t1;
-        TCGCond condition;
-        uint8_t pos, len;
-        uint32_t tmp32;
-        uint64_t tmp64, taddr;
-        MemOpIdx oi;
-        int32_t ofs;
-        void *ptr;
-
-        insn = *tb_ptr++;
-        opc = extract32(insn, 0, 8);
-
-        switch (opc) {
-        case INDEX_op_call:
-            {
-                void *call_slots[MAX_CALL_IARGS];
-                ffi_cif *cif;
-                void *func;
-                unsigned i, s, n;
-
-                tci_args_nl(insn, tb_ptr, &len, &ptr);
-                func = ((void **)ptr)[0];
-                cif = ((void **)ptr)[1];
-
-                n = cif->nargs;
-                for (i = s = 0; i < n; ++i) {
-                    ffi_type *t = cif->arg_types[i];
-                    call_slots[i] = &stack[s];
-                    s += DIV_ROUND_UP(t->size, 8);
-                }
-
-                /* Helper functions may need to access the "return address" */
-                tci_tb_ptr = (uintptr_t)tb_ptr;
-                ffi_call(cif, func, stack, call_slots);
-            }
+    NEXT();
 
-            switch (len) {
-            case 0: /* void */
-                break;
-            case 1: /* uint32_t */
-                /*
-                 * The result winds up "left-aligned" in the stack[0] slot.
-                 * Note that libffi has an odd special case in that it will
-                 * always widen an integral result to ffi_arg.
-                 */
-                if (sizeof(ffi_arg) == 8) {
-                    regs[TCG_REG_R0] = (uint32_t)stack[0];
-                } else {
-                    regs[TCG_REG_R0] = *(uint32_t *)stack;
-                }
-                break;
-            case 2: /* uint64_t */
-                /*
-                 * For TCG_TARGET_REG_BITS == 32, the register pair
-                 * must stay in host memory order.
-                 */
-                memcpy(&regs[TCG_REG_R0], stack, 8);
-                break;
-            case 3: /* Int128 */
-                memcpy(&regs[TCG_REG_R0], stack, 16);
-                break;
-            default:
-                g_assert_not_reached();
-            }
-            break;
+    CASE(call):
+        {
+            void *call_slots[MAX_CALL_IARGS];
+            ffi_cif *cif;
+            void *func;
+            unsigned i, s, n;
 
-        case INDEX_op_br:
-            tci_args_l(insn, tb_ptr, &ptr);
-            tb_ptr = ptr;
-            continue;
-#if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            regs[r0] = tci_compare64(tci_uint64(regs[r2], regs[r1]),
-                                     tci_uint64(regs[r4], regs[r3]),
-                                     condition);
-            break;
-#elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond:
-            tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
-            regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
-            break;
-        case INDEX_op_movcond:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            tmp32 = tci_compare64(regs[r1], regs[r2], condition);
-            regs[r0] = regs[tmp32 ? r3 : r4];
-            break;
-#endif
-        case INDEX_op_mov:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = regs[r1];
-            break;
-        case INDEX_op_tci_movi:
-            tci_args_ri(insn, &r0, &t1);
-            regs[r0] = t1;
-            break;
-        case INDEX_op_tci_movl:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
-        case INDEX_op_tci_setcarry:
-            carry = true;
-            break;
+            tci_args_nl(insn, tb_ptr, &len, &ptr);
+            func = ((void **)ptr)[0];
+            cif = ((void **)ptr)[1];
 
-            /* Load/store operations (32 bit). */
-
-        case INDEX_op_ld8u:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint8_t *)ptr;
-            break;
-        case INDEX_op_ld8s:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int8_t *)ptr;
-            break;
-        case INDEX_op_ld16u:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint16_t *)ptr;
-            break;
-        case INDEX_op_ld16s:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int16_t *)ptr;
-            break;
-        case INDEX_op_ld:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
-        case INDEX_op_st8:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint8_t *)ptr = regs[r0];
-            break;
-        case INDEX_op_st16:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint16_t *)ptr = regs[r0];
-            break;
-        case INDEX_op_st:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(tcg_target_ulong *)ptr = regs[r0];
-            break;
+            n = cif->nargs;
+            for (i = s = 0; i < n; ++i) {
+                ffi_type *t = cif->arg_types[i];
+                call_slots[i] = &stack[s];
+                s += DIV_ROUND_UP(t->size, 8);
+            }
 
-            /* Arithmetic operations (mixed 32/64 bit). */
+            /* Helper functions may need to access the "return address" */
+            tci_tb_ptr = (uintptr_t)tb_ptr;
+            ffi_call(cif, func, stack, call_slots);
+        }
 
-        case INDEX_op_add:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] + regs[r2];
-            break;
-        case INDEX_op_sub:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] - regs[r2];
-            break;
-        case INDEX_op_mul:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] * regs[r2];
-            break;
-        case INDEX_op_and:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] & regs[r2];
-            break;
-        case INDEX_op_or:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] | regs[r2];
-            break;
-        case INDEX_op_xor:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ^ regs[r2];
-            break;
-        case INDEX_op_andc:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] & ~regs[r2];
-            break;
-        case INDEX_op_orc:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] | ~regs[r2];
-            break;
-        case INDEX_op_eqv:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] ^ regs[r2]);
-            break;
-        case INDEX_op_nand:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] & regs[r2]);
-            break;
-        case INDEX_op_nor:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ~(regs[r1] | regs[r2]);
-            break;
-        case INDEX_op_neg:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = -regs[r1];
+        switch (len) {
+        case 0: /* void */
+            break;
+        case 1: /* uint32_t */
+            /*
+             * The result winds up "left-aligned" in the stack[0] slot.
+             * Note that libffi has an odd special case in that it will
+             * always widen an integral result to ffi_arg.
+             */
+            if (sizeof(ffi_arg) == 8) {
+                regs[TCG_REG_R0] = (uint32_t)stack[0];
+            } else {
+                regs[TCG_REG_R0] = *(uint32_t *)stack;
+            }
             break;
-        case INDEX_op_not:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = ~regs[r1];
+        case 2: /* uint64_t */
+            /*
+             * For TCG_TARGET_REG_BITS == 32, the register pair
+             * must stay in host memory order.
+             */
+            memcpy(&regs[TCG_REG_R0], stack, 8);
             break;
-        case INDEX_op_ctpop:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = ctpop_tr(regs[r1]);
+        case 3: /* Int128 */
+            memcpy(&regs[TCG_REG_R0], stack, 16);
             break;
-        case INDEX_op_addco:
-            tci_args_rrr(insn, &r0, &r1, &r2);
+        default:
+            g_assert_not_reached();
+        }
+        NEXT();
+
+    CASE(br):
+        tci_args_l(insn, tb_ptr, &ptr);
+        tb_ptr = ptr;
+        NEXT();
+#if TCG_TARGET_REG_BITS == 32
+    CASE(setcond2_i32):
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        regs[r0] = tci_compare64(tci_uint64(regs[r2], regs[r1]),
+                                 tci_uint64(regs[r4], regs[r3]),
+                                 condition);
+        NEXT();
+#elif TCG_TARGET_REG_BITS == 64
+    CASE(setcond):
+        tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
+        regs[r0] = tci_compare64(regs[r1], regs[r2], condition);
+        NEXT();
+    CASE(movcond):
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        tmp32 = tci_compare64(regs[r1], regs[r2], condition);
+        regs[r0] = regs[tmp32 ? r3 : r4];
+        NEXT();
+#endif
+    CASE(mov):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = regs[r1];
+        NEXT();
+    CASE(tci_movi):
+        tci_args_ri(insn, &r0, &t1);
+        regs[r0] = t1;
+        NEXT();
+    CASE(tci_movl):
+        tci_args_rl(insn, tb_ptr, &r0, &ptr);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        NEXT();
+    CASE(tci_setcarry):
+        carry = true;
+        NEXT();
+
+        /* Load/store operations (32 bit). */
+
+    CASE(ld8u):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint8_t *)ptr;
+        NEXT();
+    CASE(ld8s):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int8_t *)ptr;
+        NEXT();
+    CASE(ld16u):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint16_t *)ptr;
+        NEXT();
+    CASE(ld16s):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int16_t *)ptr;
+        NEXT();
+    CASE(ld):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        NEXT();
+    CASE(st8):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint8_t *)ptr = regs[r0];
+        NEXT();
+    CASE(st16):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint16_t *)ptr = regs[r0];
+        NEXT();
+    CASE(st):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
+
+        /* Arithmetic operations (mixed 32/64 bit). */
+
+    CASE(add):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] + regs[r2];
+        NEXT();
+    CASE(sub):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] - regs[r2];
+        NEXT();
+    CASE(mul):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] * regs[r2];
+        NEXT();
+    CASE(and):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & regs[r2];
+        NEXT();
+    CASE(or):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | regs[r2];
+        NEXT();
+    CASE(xor):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ^ regs[r2];
+        NEXT();
+    CASE(andc):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & ~regs[r2];
+        NEXT();
+    CASE(orc):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | ~regs[r2];
+        NEXT();
+    CASE(eqv):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] ^ regs[r2]);
+        NEXT();
+    CASE(nand):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] & regs[r2]);
+        NEXT();
+    CASE(nor):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ~(regs[r1] | regs[r2]);
+        NEXT();
+    CASE(neg):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = -regs[r1];
+        NEXT();
+    CASE(not):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = ~regs[r1];
+        NEXT();
+    CASE(ctpop):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = ctpop_tr(regs[r1]);
+        NEXT();
+    CASE(addco):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        t1 = regs[r1] + regs[r2];
+        carry = t1 < regs[r1];
+        regs[r0] = t1;
+        NEXT();
+    CASE(addci):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] + regs[r2] + carry;
+        NEXT();
+    CASE(addcio):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        if (carry) {
+            t1 = regs[r1] + regs[r2] + 1;
+            carry = t1 <= regs[r1];
+        } else {
             t1 = regs[r1] + regs[r2];
             carry = t1 < regs[r1];
-            regs[r0] = t1;
-            break;
-        case INDEX_op_addci:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] + regs[r2] + carry;
-            break;
-        case INDEX_op_addcio:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            if (carry) {
-                t1 = regs[r1] + regs[r2] + 1;
-                carry = t1 <= regs[r1];
-            } else {
-                t1 = regs[r1] + regs[r2];
-                carry = t1 < regs[r1];
-            }
-            regs[r0] = t1;
-            break;
-        case INDEX_op_subbo:
-            tci_args_rrr(insn, &r0, &r1, &r2);
+        }
+        regs[r0] = t1;
+        NEXT();
+    CASE(subbo):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        carry = regs[r1] < regs[r2];
+        regs[r0] = regs[r1] - regs[r2];
+        NEXT();
+    CASE(subbi):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] - regs[r2] - carry;
+        NEXT();
+    CASE(subbio):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        if (carry) {
+            carry = regs[r1] <= regs[r2];
+            regs[r0] = regs[r1] - regs[r2] - 1;
+        } else {
             carry = regs[r1] < regs[r2];
             regs[r0] = regs[r1] - regs[r2];
-            break;
-        case INDEX_op_subbi:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] - regs[r2] - carry;
-            break;
-        case INDEX_op_subbio:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            if (carry) {
-                carry = regs[r1] <= regs[r2];
-                regs[r0] = regs[r1] - regs[r2] - 1;
-            } else {
-                carry = regs[r1] < regs[r2];
-                regs[r0] = regs[r1] - regs[r2];
-            }
-            break;
-        case INDEX_op_muls2:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        }
+        NEXT();
+    CASE(muls2):
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
 #if TCG_TARGET_REG_BITS == 32
-            tmp64 = (int64_t)(int32_t)regs[r2] * (int32_t)regs[r3];
-            tci_write_reg64(regs, r1, r0, tmp64);
+        tmp64 = (int64_t)(int32_t)regs[r2] * (int32_t)regs[r3];
+        tci_write_reg64(regs, r1, r0, tmp64);
 #else
-            muls64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
+        muls64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
 #endif
-            break;
-        case INDEX_op_mulu2:
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        NEXT();
+    CASE(mulu2):
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
 #if TCG_TARGET_REG_BITS == 32
-            tmp64 = (uint64_t)(uint32_t)regs[r2] * (uint32_t)regs[r3];
-            tci_write_reg64(regs, r1, r0, tmp64);
+        tmp64 = (uint64_t)(uint32_t)regs[r2] * (uint32_t)regs[r3];
+        tci_write_reg64(regs, r1, r0, tmp64);
 #else
-            mulu64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
+        mulu64(&regs[r0], &regs[r1], regs[r2], regs[r3]);
 #endif
-            break;
+        NEXT();
 
-            /* Arithmetic operations (32 bit). */
+        /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_tci_divs32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int32_t)regs[r1] / (int32_t)regs[r2];
-            break;
-        case INDEX_op_tci_divu32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] / (uint32_t)regs[r2];
-            break;
-        case INDEX_op_tci_rems32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int32_t)regs[r1] % (int32_t)regs[r2];
-            break;
-        case INDEX_op_tci_remu32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint32_t)regs[r1] % (uint32_t)regs[r2];
-            break;
-        case INDEX_op_tci_clz32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            tmp32 = regs[r1];
-            regs[r0] = tmp32 ? clz32(tmp32) : regs[r2];
-            break;
-        case INDEX_op_tci_ctz32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            tmp32 = regs[r1];
-            regs[r0] = tmp32 ? ctz32(tmp32) : regs[r2];
-            break;
-        case INDEX_op_tci_setcond32:
-            tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
-            regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
-            break;
-        case INDEX_op_tci_movcond32:
-            tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
-            tmp32 = tci_compare32(regs[r1], regs[r2], condition);
-            regs[r0] = regs[tmp32 ? r3 : r4];
-            break;
-
-            /* Shift/rotate operations. */
-
-        case INDEX_op_shl:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] << (regs[r2] % TCG_TARGET_REG_BITS);
-            break;
-        case INDEX_op_shr:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] >> (regs[r2] % TCG_TARGET_REG_BITS);
-            break;
-        case INDEX_op_sar:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ((tcg_target_long)regs[r1]
-                        >> (regs[r2] % TCG_TARGET_REG_BITS));
-            break;
-        case INDEX_op_tci_rotl32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = rol32(regs[r1], regs[r2] & 31);
-            break;
-        case INDEX_op_tci_rotr32:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ror32(regs[r1], regs[r2] & 31);
-            break;
-        case INDEX_op_deposit:
-            tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
-            regs[r0] = deposit_tr(regs[r1], pos, len, regs[r2]);
-            break;
-        case INDEX_op_extract:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = extract_tr(regs[r1], pos, len);
-            break;
-        case INDEX_op_sextract:
-            tci_args_rrbb(insn, &r0, &r1, &pos, &len);
-            regs[r0] = sextract_tr(regs[r1], pos, len);
-            break;
-        case INDEX_op_brcond:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
-                tb_ptr = ptr;
-            }
-            break;
-        case INDEX_op_bswap16:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap16(regs[r1]);
-            break;
-        case INDEX_op_bswap32:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap32(regs[r1]);
-            break;
+    CASE(tci_divs32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int32_t)regs[r1] / (int32_t)regs[r2];
+        NEXT();
+    CASE(tci_divu32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] / (uint32_t)regs[r2];
+        NEXT();
+    CASE(tci_rems32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int32_t)regs[r1] % (int32_t)regs[r2];
+        NEXT();
+    CASE(tci_remu32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint32_t)regs[r1] % (uint32_t)regs[r2];
+        NEXT();
+    CASE(tci_clz32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        tmp32 = regs[r1];
+        regs[r0] = tmp32 ? clz32(tmp32) : regs[r2];
+        NEXT();
+    CASE(tci_ctz32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        tmp32 = regs[r1];
+        regs[r0] = tmp32 ? ctz32(tmp32) : regs[r2];
+        NEXT();
+    CASE(tci_setcond32):
+        tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
+        regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
+        NEXT();
+    CASE(tci_movcond32):
+        tci_args_rrrrrc(insn, &r0, &r1, &r2, &r3, &r4, &condition);
+        tmp32 = tci_compare32(regs[r1], regs[r2], condition);
+        regs[r0] = regs[tmp32 ? r3 : r4];
+        NEXT();
+
+        /* Shift/rotate operations. */
+
+    CASE(shl):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] << (regs[r2] % TCG_TARGET_REG_BITS);
+        NEXT();
+    CASE(shr):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] >> (regs[r2] % TCG_TARGET_REG_BITS);
+        NEXT();
+    CASE(sar):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ((tcg_target_long)regs[r1]
+                    >> (regs[r2] % TCG_TARGET_REG_BITS));
+        NEXT();
+    CASE(tci_rotl32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = rol32(regs[r1], regs[r2] & 31);
+        NEXT();
+    CASE(tci_rotr32):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ror32(regs[r1], regs[r2] & 31);
+        NEXT();
+    CASE(deposit):
+        tci_args_rrrbb(insn, &r0, &r1, &r2, &pos, &len);
+        regs[r0] = deposit_tr(regs[r1], pos, len, regs[r2]);
+        NEXT();
+    CASE(extract):
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = extract_tr(regs[r1], pos, len);
+        NEXT();
+    CASE(sextract):
+        tci_args_rrbb(insn, &r0, &r1, &pos, &len);
+        regs[r0] = sextract_tr(regs[r1], pos, len);
+        NEXT();
+    CASE(brcond):
+        tci_args_rl(insn, tb_ptr, &r0, &ptr);
+        if (regs[r0]) {
+            tb_ptr = ptr;
+        }
+        NEXT();
+    CASE(bswap16):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap16(regs[r1]);
+        NEXT();
+    CASE(bswap32):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap32(regs[r1]);
+        NEXT();
 #if TCG_TARGET_REG_BITS == 64
-            /* Load/store operations (64 bit). */
-
-        case INDEX_op_ld32u:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(uint32_t *)ptr;
-            break;
-        case INDEX_op_ld32s:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            regs[r0] = *(int32_t *)ptr;
-            break;
-        case INDEX_op_st32:
-            tci_args_rrs(insn, &r0, &r1, &ofs);
-            ptr = (void *)(regs[r1] + ofs);
-            *(uint32_t *)ptr = regs[r0];
-            break;
-
-            /* Arithmetic operations (64 bit). */
-
-        case INDEX_op_divs:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int64_t)regs[r1] / (int64_t)regs[r2];
-            break;
-        case INDEX_op_divu:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint64_t)regs[r1] / (uint64_t)regs[r2];
-            break;
-        case INDEX_op_rems:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (int64_t)regs[r1] % (int64_t)regs[r2];
-            break;
-        case INDEX_op_remu:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = (uint64_t)regs[r1] % (uint64_t)regs[r2];
-            break;
-        case INDEX_op_clz:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ? clz64(regs[r1]) : regs[r2];
-            break;
-        case INDEX_op_ctz:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = regs[r1] ? ctz64(regs[r1]) : regs[r2];
-            break;
+        /* Load/store operations (64 bit). */
+
+    CASE(ld32u):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(uint32_t *)ptr;
+        NEXT();
+    CASE(ld32s):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(int32_t *)ptr;
+        NEXT();
+    CASE(st32):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(uint32_t *)ptr = regs[r0];
+        NEXT();
+
+        /* Arithmetic operations (64 bit). */
+
+    CASE(divs):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int64_t)regs[r1] / (int64_t)regs[r2];
+        NEXT();
+    CASE(divu):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint64_t)regs[r1] / (uint64_t)regs[r2];
+        NEXT();
+    CASE(rems):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (int64_t)regs[r1] % (int64_t)regs[r2];
+        NEXT();
+    CASE(remu):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = (uint64_t)regs[r1] % (uint64_t)regs[r2];
+        NEXT();
+    CASE(clz):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ? clz64(regs[r1]) : regs[r2];
+        NEXT();
+    CASE(ctz):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ? ctz64(regs[r1]) : regs[r2];
+        NEXT();
 
-            /* Shift/rotate operations (64 bit). */
+        /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_rotl:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = rol64(regs[r1], regs[r2] & 63);
-            break;
-        case INDEX_op_rotr:
-            tci_args_rrr(insn, &r0, &r1, &r2);
-            regs[r0] = ror64(regs[r1], regs[r2] & 63);
-            break;
-        case INDEX_op_ext_i32_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (int32_t)regs[r1];
-            break;
-        case INDEX_op_extu_i32_i64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = (uint32_t)regs[r1];
-            break;
-        case INDEX_op_bswap64:
-            tci_args_rr(insn, &r0, &r1);
-            regs[r0] = bswap64(regs[r1]);
-            break;
+    CASE(rotl):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = rol64(regs[r1], regs[r2] & 63);
+        NEXT();
+    CASE(rotr):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = ror64(regs[r1], regs[r2] & 63);
+        NEXT();
+    CASE(ext_i32_i64):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (int32_t)regs[r1];
+        NEXT();
+    CASE(extu_i32_i64):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = (uint32_t)regs[r1];
+        NEXT();
+    CASE(bswap64):
+        tci_args_rr(insn, &r0, &r1);
+        regs[r0] = bswap64(regs[r1]);
+        NEXT();
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
-            /* QEMU specific operations. */
+        /* Superinstructions, see tcg-target.c.inc. */
 
-        case INDEX_op_exit_tb:
-            tci_args_l(insn, tb_ptr, &ptr);
-            return (uintptr_t)ptr;
+    CASE(tci_brcond32):
+        tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+        if (tci_compare32(regs[r0], regs[r1], condition)) {
+            tb_ptr = ptr;
+        }
+        NEXT();
+#if TCG_TARGET_REG_BITS == 64
+    CASE(tci_brcond):
+        tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+        if (tci_compare64(regs[r0], regs[r1], condition)) {
+            tb_ptr = ptr;
+        }
+        NEXT();
+#endif
+    CASE(tci_ld_add):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        regs[r0] = regs[r1] + regs[r2];
+        NEXT();
+    CASE(tci_ld_sub):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        regs[r0] = regs[r1] - regs[r2];
+        NEXT();
+    CASE(tci_ld_and):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & regs[r2];
+        NEXT();
+    CASE(tci_ld_or):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | regs[r2];
+        NEXT();
+    CASE(tci_ld_xor):
+        tci_args_rrs(insn, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        regs[r0] = *(tcg_target_ulong *)ptr;
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ^ regs[r2];
+        NEXT();
+    CASE(tci_add_st):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] + regs[r2];
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
+    CASE(tci_sub_st):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] - regs[r2];
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
+    CASE(tci_and_st):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] & regs[r2];
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
+    CASE(tci_or_st):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] | regs[r2];
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
+    CASE(tci_xor_st):
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        regs[r0] = regs[r1] ^ regs[r2];
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &ofs);
+        ptr = (void *)(regs[r1] + ofs);
+        *(tcg_target_ulong *)ptr = regs[r0];
+        NEXT();
 
-        case INDEX_op_goto_tb:
-            tci_args_l(insn, tb_ptr, &ptr);
-            tb_ptr = *(void **)ptr;
-            break;
+        /* QEMU specific operations. */
 
-        case INDEX_op_goto_ptr:
-            tci_args_r(insn, &r0);
-            ptr = (void *)regs[r0];
-            if (!ptr) {
-                return 0;
-            }
-            tb_ptr = ptr;
-            break;
+    CASE(exit_tb):
+        tci_args_l(insn, tb_ptr, &ptr);
+        return (uintptr_t)ptr;
 
-        case INDEX_op_qemu_ld:
-            tci_args_rrm(insn, &r0, &r1, &oi);
-            taddr = regs[r1];
-            regs[r0] = tci_qemu_ld(env, taddr, oi, tb_ptr);
-            break;
+    CASE(goto_tb):
+        tci_args_l(insn, tb_ptr, &ptr);
+        tb_ptr = *(void **)ptr;
+        NEXT();
 
-        case INDEX_op_qemu_st:
-            tci_args_rrm(insn, &r0, &r1, &oi);
-            taddr = regs[r1];
-            tci_qemu_st(env, taddr, regs[r0], oi, tb_ptr);
-            break;
+    CASE(goto_ptr):
+        tci_args_r(insn, &r0);
+        ptr = (void *)regs[r0];
+        if (!ptr) {
+            return 0;
+        }
+        tb_ptr = ptr;
+        NEXT();
 
-        case INDEX_op_qemu_ld2:
-            tcg_debug_assert(TCG_TARGET_REG_BITS == 32);
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            taddr = regs[r2];
-            oi = regs[r3];
-            tmp64 = tci_qemu_ld(env, taddr, oi, tb_ptr);
-            tci_write_reg64(regs, r1, r0, tmp64);
-            break;
+    CASE(qemu_ld):
+        tci_args_rrm(insn, &r0, &r1, &oi);
+        taddr = regs[r1];
+        regs[r0] = tci_qemu_ld(env, taddr, oi, tb_ptr);
+        NEXT();
 
-        case INDEX_op_qemu_st2:
-            tcg_debug_assert(TCG_TARGET_REG_BITS == 32);
-            tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
-            tmp64 = tci_uint64(regs[r1], regs[r0]);
-            taddr = regs[r2];
-            oi = regs[r3];
-            tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
-            break;
+    CASE(qemu_st):
+        tci_args_rrm(insn, &r0, &r1, &oi);
+        taddr = regs[r1];
+        tci_qemu_st(env, taddr, regs[r0], oi, tb_ptr);
+        NEXT();
 
-        case INDEX_op_mb:
-            /* Ensure ordering for all kinds */
-            smp_mb();
-            break;
-        default:
-            g_assert_not_reached();
-        }
-    }
+    CASE(qemu_ld2):
+        tcg_debug_assert(TCG_TARGET_REG_BITS == 32);
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        taddr = regs[r2];
+        oi = regs[r3];
+        tmp64 = tci_qemu_ld(env, taddr, oi, tb_ptr);
+        tci_write_reg64(regs, r1, r0, tmp64);
+        NEXT();
+
+    CASE(qemu_st2):
+        tcg_debug_assert(TCG_TARGET_REG_BITS == 32);
+        tci_args_rrrr(insn, &r0, &r1, &r2, &r3);
+        tmp64 = tci_uint64(regs[r1], regs[r0]);
+        taddr = regs[r2];
+        oi = regs[r3];
+        tci_qemu_st(env, taddr, tmp64, oi, tb_ptr);
+        NEXT();
+
+    CASE(mb):
+        /* Ensure ordering for all kinds */
+        smp_mb();
+        NEXT();
+
+    CASE(illegal):
+        g_assert_not_reached();
+
+#undef CASE
+#undef TARGET
+#undef NEXT
 }
 
 /*
@@ -920,6 +1132,39 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond32:
+    case INDEX_op_tci_brcond:
+        tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        break;
+
+    case INDEX_op_tci_ld_add:
+    case INDEX_op_tci_ld_sub:
+    case INDEX_op_tci_ld_and:
+    case INDEX_op_tci_ld_or:
+    case INDEX_op_tci_ld_xor:
+        tci_args_rrs(insn, &r0, &r1, &s2);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %d; ",
+                           op_name, str_r(r0), str_r(r1), s2);
+        tci_args_rrr(*tb_ptr++, &r0, &r1, &r2);
+        info->fprintf_func(info->stream, "%s, %s, %s",
+                           str_r(r0), str_r(r1), str_r(r2));
+        break;
+
+    case INDEX_op_tci_add_st:
+    case INDEX_op_tci_sub_st:
+    case INDEX_op_tci_and_st:
+    case INDEX_op_tci_or_st:
+    case INDEX_op_tci_xor_st:
+        tci_args_rrr(insn, &r0, &r1, &r2);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s; ",
+                           op_name, str_r(r0), str_r(r1), str_r(r2));
+        tci_args_rrs(*tb_ptr++, &r0, &r1, &s2);
+        info->fprintf_func(info->stream, "%s, %s, %d",
+                           str_r(r0), str_r(r1), s2);
+        break;
+
     case INDEX_op_setcond:
     case INDEX_op_tci_setcond32:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
@@ -1071,5 +1316,5 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
         break;
     }
 
-    return sizeof(insn);
+    return (uintptr_t)tb_ptr - addr;
 }
@@ -0,0 +1,136 @@
+/*
+ * Micro-benchmark of the TCG backend in use
+ *
+ * Each kernel stresses one kind of code that the interpreter (TCI)
+ * handles differently from a native backend: short loops ending in a
+ * compare and branch, guest values going through the CPU state, and
+ * indirect calls.  Run the same binary under a QEMU configured with
+ * --enable-tcg-interpreter and under one without it to compare them:
+ *
+ *   qemu-x86_64 tci-bench 200
+ *
+ * The argument scales the work; the default keeps "make check-tcg"
+ * quick.  The checksums let the run double as a correctness test.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define N 1024
+
+static uint32_t a[N], b[N];
+
+/* Tight loops with data-dependent branches. */
+static uint64_t bench_branch(unsigned reps)
+{
+    uint64_t steps = 0;
+    unsigned r, i;
+
+    for (r = 0; r < reps; r++) {
+        for (i = 1; i < N; i++) {
+            uint32_t x = i + r;
+
+            while (x != 1) {
+                x = x & 1 ? 3 * x + 1 : x / 2;
+                steps++;
+            }
+        }
+    }
+    return steps;
+}
+
+/* Read-modify-write of memory and of a handful of live values. */
+static uint64_t bench_ldst(unsigned reps)
+{
+    uint32_t x = 0, y = 1;
+    unsigned r, i;
+
+    for (i = 0; i < N; i++) {
+        a[i] = i * 2654435761u;
+        b[i] = i;
+    }
+    for (r = 0; r < reps * 16; r++) {
+        for (i = 0; i < N; i++) {
+            a[i] += b[i] ^ x;
+            b[i] -= a[i] & y;
+            x += a[i];
+            y |= x;
+        }
+    }
+    return x ^ y;
+}
+
+static uint32_t f_add(uint32_t x)
+{
+    return x + 3;
+}
+
+static uint32_t f_mix(uint32_t x)
+{
+    return (x << 5) ^ (x >> 3);
+}
+
+static uint32_t f_neg(uint32_t x)
+{
+    return -x;
+}
+
+/* Calls through pointers, which end the TB at an indirect jump. */
+static uint64_t bench_call(unsigned reps)
+{
+    static uint32_t (* volatile fn[3])(uint32_t) = { f_add, f_mix, f_neg };
+    uint32_t x = 1;
+    unsigned r, i;
+
+    for (r = 0; r < reps * 64; r++) {
+        for (i = 0; i < N; i++) {
+            x = fn[i % 3](x);
+        }
+    }
+    return x;
+}
+
+static const struct {
+    const char *name;
+    uint64_t (*fn)(unsigned reps);
+    uint64_t sum;       /* expected result for reps == 1 */
+} kernels[] = {
+    { "branch", bench_branch, 0xef7b },
+    { "ldst", bench_ldst, 0xd185e7d9 },
+    { "call", bench_call, 0x63aa16fb },
+};
+
+int main(int argc, char **argv)
+{
+    unsigned reps = argc > 1 ? atoi(argv[1]) : 1;
+    unsigned i;
+    int err = 0;
+
+    if (reps == 0) {
+        fprintf(stderr, "usage: %s [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        struct timespec t0, t1;
+        uint64_t sum;
+        double ms;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        sum = kernels[i].fn(reps);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+        printf("%-8s %10.2f ms  sum %016llx\n",
+               kernels[i].name, ms, (unsigned long long)sum);
+        if (reps == 1 && sum != kernels[i].sum) {
+            fprintf(stderr, "%s: expected %016llx\n", kernels[i].name,
+                    (unsigned long long)kernels[i].sum);
+            err = 1;
+        }
+    }
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Hot blocks chained by forward JMP rel, which -tb-tier merges into
+ * superblocks.  Several threads run them at once, so racing updates
+ * of a block's execution counter are exercised too.  The sums must
+ * come out the same as without tiering.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define NTHREADS 4
+#define ITERS    200000
+
+static uint64_t chain(uint64_t x)
+{
+    /* Each jmp ends a first-tier TB; a second-tier TB follows it. */
+    asm("add $1, %0\n\t"
+        "jmp 1f\n\t"
+        "ud2\n"
+        "1:\n\t"
+        "imul $3, %0\n\t"
+        "jmp 2f\n\t"
+        "ud2\n"
+        "2:\n\t"
+        "xor $0x55, %0\n\t"
+        "jmp 3f\n\t"
+        "ud2\n"
+        "3:\n\t"
+        "sub $7, %0"
+        : "+r"(x));
+    return x;
+}
+
+static uint64_t chain_ref(uint64_t x)
+{
+    return (((x + 1) * 3) ^ 0x55) - 7;
+}
+
+static void *run(void *arg)
+{
+    uint64_t seed = (uintptr_t)arg;
+    uint64_t x = seed, y = seed;
+    int i;
+
+    for (i = 0; i < ITERS; i++) {
+        x = chain(x);
+        y = chain_ref(y);
+    }
+    assert(x == y);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t th[NTHREADS];
+    int i;
+
+    for (i = 0; i < NTHREADS; i++) {
+        assert(pthread_create(&th[i], NULL, run,
+                              (void *)(uintptr_t)(i + 1)) == 0);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        assert(pthread_join(th[i], NULL) == 0);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Buffer cache benchmark, in the style of stressfs.
+//
+// Each of nproc processes writes its own files of nblocks blocks
+// in total, then reads them back round after round.  The buffer
+// cache statistics show the hit rate and the average cost of a
+// lookup; rebuild with e.g. "make NBUF=4096" to compare sizes.
+//
+// usage: bcachebench [nproc [nblocks [rounds]]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "bstat.h"
+
+#define FILEBLOCKS 128   // blocks per file, below MAXFILE
+
+char buf[BSIZE];
+
+void
+path(char *p, int w, int f)
+{
+  strcpy(p, "bcb.0.00");
+  p[4] += w;
+  p[6] += f / 10;
+  p[7] += f % 10;
+}
+
+// Write nblocks blocks of files for worker w.
+void
+writefiles(int w, int nblocks)
+{
+  char p[16];
+  int f, i, fd;
+
+  memset(buf, 'a' + w, sizeof(buf));
+  for(f = 0; f * FILEBLOCKS < nblocks; f++){
+    path(p, w, f);
+    if((fd = open(p, O_CREATE | O_RDWR)) < 0){
+      printf(1, "bcachebench: cannot create %s\n", p);
+      exit();
+    }
+    for(i = f * FILEBLOCKS; i < nblocks && i < (f+1) * FILEBLOCKS; i++)
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf(1, "bcachebench: write failed\n");
+        exit();
+      }
+    close(fd);
+  }
+}
+
+// Read back the files of worker w.
+void
+readfiles(int w, int nblocks)
+{
+  char p[16];
+  int f, fd;
+
+  for(f = 0; f * FILEBLOCKS < nblocks; f++){
+    path(p, w, f);
+    if((fd = open(p, O_RDONLY)) < 0){
+      printf(1, "bcachebench: cannot open %s\n", p);
+      exit();
+    }
+    while(read(fd, buf, sizeof(buf)) == sizeof(buf))
+      ;
+    close(fd);
+  }
+}
+
+void
+removefiles(int w, int nblocks)
+{
+  char p[16];
+  int f;
+
+  for(f = 0; f * FILEBLOCKS < nblocks; f++){
+    path(p, w, f);
+    unlink(p);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bstat st;
+  int nproc, nblocks, rounds, w, r, t0, t1, lookups;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 4;
+  nblocks = argc > 2 ? atoi(argv[2]) : 256;
+  rounds = argc > 3 ? atoi(argv[3]) : 4;
+  if(nproc < 1 || nproc > 9 || nblocks < 1 || nblocks > 99 * FILEBLOCKS){
+    printf(1, "usage: bcachebench [nproc(1-9) [nblocks [rounds]]]\n");
+    exit();
+  }
+
+  bstat(&st, 0);
+  printf(1, "bcachebench: %d procs x %d blocks, %d rounds, nbuf %d, nbucket %d\n",
+         nproc, nblocks, rounds, st.nbuf, st.nbucket);
+
+  for(w = 0; w < nproc; w++)
+    if(fork() == 0){
+      writefiles(w, nblocks);
+      exit();
+    }
+  for(w = 0; w < nproc; w++)
+    wait();
+
+  bstat(&st, 1);
+  t0 = uptime();
+  for(w = 0; w < nproc; w++)
+    if(fork() == 0){
+      for(r = 0; r < rounds; r++)
+        readfiles(w, nblocks);
+      exit();
+    }
+  for(w = 0; w < nproc; w++)
+    wait();
+  t1 = uptime();
+  bstat(&st, 0);
+
+  lookups = st.hits + st.misses + st.steals;
+  printf(1, "lookups %d: hits %d misses %d steals %d, hit rate %d%%\n",
+         lookups, st.hits, st.misses, st.steals,
+         lookups ? st.hits * 100 / lookups : 0);
+  printf(1, "%d cycles per lookup, %d ticks\n", st.cycles, t1 - t0);
+
+  for(w = 0; w < nproc; w++)
+    removefiles(w, nblocks);
+  exit();
+}
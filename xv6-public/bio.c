@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,6 +17,13 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are hashed by (dev, blockno) into buckets, each with its
+// own lock and its own LRU list, so lookups of different blocks
+// proceed in parallel.  A miss recycles the least recently used
+// free buffer of its bucket, or steals one from another bucket.
+// The number of buffers is chosen at boot, after all of memory
+// has been handed to kalloc.
 
 #include "types.h"
 #include "defs.h"
@@ -26,70 +33,237 @@
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "bstat.h"
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // Most recently used; head->prev is least.
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct {
+  struct spinlock lock;   // Held while stealing between buckets
+  int nbuf;
+  int nbucket;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+// Statistics, per CPU so that counting does not share cache lines.
+enum { BHIT, BMISS, BSTEAL };
+struct {
+  uint count[3];          // Lookups by outcome
+  uint64 cycles;          // Spent in bget()
+} bstats[NCPU];
+
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % bcache.nbucket)
+
+// Add b to bk as most recently used.
+static void
+bpush(struct bucket *bk, struct buf *b)
+{
+  if(bk->head == 0){
+    b->next = b->prev = b;
+  } else {
+    b->next = bk->head;
+    b->prev = bk->head->prev;
+    b->prev->next = b;
+    b->next->prev = b;
+  }
+  bk->head = b;
+}
+
+// Remove b from bk.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  if(b->next == b){
+    bk->head = 0;
+    return;
+  }
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  if(bk->head == b)
+    bk->head = b->next;
+}
+
+// Return the buffer caching (dev, blockno) in bk, or 0.
+// Caller holds bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bk->head) == 0)
+    return 0;
+  do {
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+    b = b->next;
+  } while(b != bk->head);
+  return 0;
+}
+
+// Return the least recently used buffer of bk that can be
+// recycled, or 0.  Even if refcnt==0, B_DIRTY indicates a buffer
+// is in use because log.c has modified it but not yet committed it.
+// Caller holds bk->lock.
+static struct buf*
+bvictim(struct bucket *bk)
+{
+  struct buf *b;
+
+  if(bk->head == 0)
+    return 0;
+  b = bk->head;
+  do {
+    b = b->prev;
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+      return b;
+  } while(b != bk->head);
+  return 0;
+}
+
+// Count a lookup with outcome what that started at cycle t0.
+static void
+bcount(int what, uint64 t0)
+{
+  uint64 t;
+  int id;
+
+  t = rdtsc() - t0;
+  pushcli();
+  id = cpuid();
+  bstats[id].count[what]++;
+  bstats[id].cycles += t;
+  popcli();
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  char *page;
+  int i, max;
 
   initlock(&bcache.lock, "bcache");
 
+  // NBUF buffers, but leave at least 3/4 of memory to the rest.
+  // The log pins up to LOGSIZE buffers until it commits.
+  max = getNumFreePages() / 4 * (PGSIZE / sizeof(struct buf));
+  bcache.nbuf = NBUF < max ? NBUF : max;
+  if(bcache.nbuf < LOGSIZE + MAXOPBLOCKS*3)
+    bcache.nbuf = LOGSIZE + MAXOPBLOCKS*3;
+  if(bcache.nbuf > max)
+    panic("binit: too little memory");
+  bcache.nbucket = bcache.nbuf / 4 | 1;
+  if(bcache.nbucket > NBUCKET)
+    bcache.nbucket = NBUCKET;
+  for(i = 0; i < bcache.nbucket; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Carve buffers out of whole pages and deal them to the buckets.
+  b = 0;
+  page = 0;
+  for(i = 0; i < bcache.nbuf; i++){
+    if(page == 0 || (char*)(b + 1) > page + PGSIZE){
+      if((page = kalloc()) == 0)
+        panic("binit");
+      b = (struct buf*)page;
+    }
+    memset(b, 0, sizeof(*b));
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bpush(&bcache.bucket[i % bcache.nbucket], b);
+    b++;
   }
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For read-ahead (prefetch set), return 0 instead if the block
+// is already cached or no buffer is free.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int prefetch)
 {
+  struct bucket *bk, *vk;
   struct buf *b;
+  uint64 t0;
+  int i, stolen;
 
-  acquire(&bcache.lock);
+  t0 = rdtsc();
+  bk = &bcache.bucket[BHASH(dev, blockno)];
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(prefetch){
+      release(&bk->lock);
+      return 0;
     }
+    b->refcnt++;
+    release(&bk->lock);
+    bcount(BHIT, t0);
+    acquiresleep(&b->lock);
+    return b;
   }
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
+  // Not cached; recycle an unused buffer of this bucket.
+  stolen = 0;
+  if((b = bvictim(bk)) == 0){
+    // Steal one from another bucket.  Only holders of bcache.lock
+    // take a second bucket lock, so this cannot deadlock.
+    release(&bk->lock);
+    acquire(&bcache.lock);
+    acquire(&bk->lock);
+    if((b = bfind(bk, dev, blockno)) != 0){
+      // Cached by someone else while bk was unlocked.
+      if(prefetch){
+        release(&bk->lock);
+        release(&bcache.lock);
+        return 0;
+      }
+      b->refcnt++;
+      release(&bk->lock);
       release(&bcache.lock);
+      bcount(BHIT, t0);
       acquiresleep(&b->lock);
       return b;
     }
+    if((b = bvictim(bk)) == 0){
+      for(i = 1; i < bcache.nbucket && b == 0; i++){
+        vk = &bcache.bucket[(bk - bcache.bucket + i) % bcache.nbucket];
+        acquire(&vk->lock);
+        if((b = bvictim(vk)) != 0){
+          bunlink(vk, b);
+          bpush(bk, b);
+          stolen = 1;
+        }
+        release(&vk->lock);
+      }
+    }
+    release(&bcache.lock);
+    if(b == 0 && prefetch){
+      release(&bk->lock);
+      return 0;
+    }
+    if(b == 0)
+      panic("bget: no buffers");
+  }
+  if(!stolen){
+    bunlink(bk, b);
+    bpush(bk, b);
   }
-  panic("bget: no buffers");
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  release(&bk->lock);
+  bcount(stolen ? BSTEAL : BMISS, t0);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -98,13 +272,21 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
   }
   return b;
 }
 
+// Return a locked buf for the indicated block without reading
+// it from disk, for a caller that will overwrite all of it.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  return bget(dev, blockno, 0);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,8 +297,55 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Start reading the indicated block into the cache, without
+// waiting for it.  Does nothing if it is cached already.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  if(b->flags & B_VALID){
+    // Someone else read it while we waited for the lock.
+    brelse(b);
+    return;
+  }
+  b->flags |= B_ASYNC;
+  ideasync(b);
+}
+
+// Start writing b's contents to disk and give b up, as brelse()
+// would, without waiting.  Must be locked.  A later bread() of
+// the block waits until the write is done.
+void
+bawrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bawrite");
+  b->flags |= B_DIRTY | B_ASYNC;
+  ideasync(b);
+}
+
+// Drop a reference to b, which is not locked by the caller.
+// Move to the head of its bucket's MRU list.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk;
+
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    bunlink(bk, b);
+    bpush(bk, b);
+  }
+  release(&bk->lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
 void
 brelse(struct buf *b)
 {
@@ -124,21 +353,40 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Finish an asynchronous transfer: unlock b on behalf of the
+// process that started it and drop that process's reference.
+// Called by ideintr().
+void
+bdone(struct buf *b)
+{
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Fill in *st with the cache size and the hit, miss and steal
+// counts summed over all CPUs, then clear the counts if reset.
+void
+bstat(struct bstat *st, int reset)
+{
+  uint64 cycles;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  st->nbuf = bcache.nbuf;
+  st->nbucket = bcache.nbucket;
+  cycles = 0;
+  for(i = 0; i < ncpu; i++){
+    st->hits += bstats[i].count[BHIT];
+    st->misses += bstats[i].count[BMISS];
+    st->steals += bstats[i].count[BSTEAL];
+    cycles += bstats[i].cycles;
+    if(reset)
+      memset(&bstats[i], 0, sizeof(bstats[i]));
   }
-  
-  release(&bcache.lock);
+  st->cycles = avg64(cycles, st->hits + st->misses + st->steals);
 }
 //PAGEBREAK!
 // Blank page.
-
@@ -0,0 +1,20 @@
+// Block layer statistics.
+
+// Buffer cache statistics, returned by bstat().
+struct bstat {
+  uint nbuf;      // Number of buffers
+  uint nbucket;   // Number of hash buckets
+  uint hits;      // Lookups that found the block cached
+  uint misses;    // Lookups that recycled a buffer of their bucket
+  uint steals;    // Lookups that took a buffer from another bucket
+  uint cycles;    // Average TSC cycles per lookup
+};
+
+// Log statistics, returned by logstat().
+struct logstat {
+  uint cap;       // Data blocks the log holds
+  uint nop;       // Operations ended (end_op calls)
+  uint ncommit;   // Transactions committed
+  uint nblocks;   // Blocks written through the log
+  uint nwait;     // Times begin_op waited for log space
+};
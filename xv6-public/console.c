@@ -237,6 +237,7 @@ consoleread(struct inode *ip, char *dst, int n)
 {
   uint target;
   int c;
+  char ch;
 
   iunlock(ip);
   target = n;
@@ -248,7 +249,11 @@ consoleread(struct inode *ip, char *dst, int n)
         ilock(ip);
         return -1;
       }
+      // Waiting for input may take long.  Nothing is copied to
+      // dst before it wakes, so its pages may go meanwhile.
+      myproc()->uidle = 1;
       sleep(&input.r, &cons.lock);
+      myproc()->uidle = 0;
     }
     c = input.buf[input.r++ % INPUT_BUF];
     if(c == C('D')){  // EOF
@@ -259,7 +264,14 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
-    *dst++ = c;
+    // Not under cons.lock: the copy may fault and sleep.
+    release(&cons.lock);
+    ch = c;
+    if(copyuser(dst++, &ch, 1) < 0){
+      ilock(ip);
+      return -1;
+    }
+    acquire(&cons.lock);
     --n;
     if(c == '\n')
       break;
@@ -273,13 +285,22 @@ consoleread(struct inode *ip, char *dst, int n)
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
-  int i;
+  char b[64];
+  int i, j, m;
 
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  for(i = 0; i < n; i += m){
+    // Copy a piece before taking cons.lock, as in consoleread.
+    m = n - i < sizeof(b) ? n - i : sizeof(b);
+    if(copyuser(b, buf + i, m) < 0){
+      ilock(ip);
+      return -1;
+    }
+    acquire(&cons.lock);
+    for(j = 0; j < m; j++)
+      consputc(b[j] & 0xff);
+    release(&cons.lock);
+  }
   ilock(ip);
 
   return n;
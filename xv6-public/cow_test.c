@@ -2,6 +2,8 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "param.h"
+#include "vmstat.h"
 
 // Helper
 void sep(char *msg) {
@@ -47,10 +49,18 @@ void test2() {
   int pid = fork();
 
   if(pid == 0) {
+    struct vmstat s0, s1;
+    vmstat(&s0, 0);
     int mid = getNumFreePages();
     p[0] = 'B';
     int after = getNumFreePages();
+    vmstat(&s1, 0);
     printf(1, "Child: before=%d mid=%d after=%d\n", before, mid, after);
+    if(s1.proc[VM_COW] - s0.proc[VM_COW] == 1)
+      printf(1, "✅ PASS (one COW copy counted)\n");
+    else
+      printf(1, "❌ FAIL: %d COW copies counted\n",
+             s1.proc[VM_COW] - s0.proc[VM_COW]);
     exit();
   }
 
@@ -1,3 +1,5 @@
+struct bstat;
+struct logstat;
 struct buf;
 struct context;
 struct file;
@@ -5,16 +7,27 @@ struct inode;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct schedstat;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct swapstat;
+struct trapframe;
+struct shmseg;
+struct vma;
+struct vmstat;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+struct buf*     bnew(uint, uint);
+void            bawrite(struct buf*);
+void            bprefetch(uint, uint);
+void            bdone(struct buf*);
+void            bstat(struct bstat*, int);
 
 // console.c
 void            consoleinit(void);
@@ -22,6 +35,10 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// copyuser.S
+int             copyuser(void*, void*, uint);
+void            copyuserfault(void);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -38,11 +55,13 @@ int             filewrite(struct file*, char*, int n);
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            ireclaim(void);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
@@ -57,6 +76,8 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf*, int);
+void            ideasync(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -72,6 +93,9 @@ int             getNumFreePages(void);
 int             getrefcount(uint);
 void            incref(uint);
 int             decref(uint);
+extern char*    zeropage;
+char*           khugealloc(void);
+void            khugefree(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -82,6 +106,7 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapictimer(int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -90,6 +115,19 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+void            logstat(struct logstat*);
+
+// mmap.c
+struct vma*     findvma(struct proc*, uint);
+uint            mmapregion(struct proc*, uint, uint, int, int, struct file*, uint);
+int             munmapregion(struct proc*, uint, uint);
+int             mmapfault(struct proc*, struct vma*, uint, int);
+int             mmapprefault(struct proc*, uint, uint, int);
+void            mmapfork(struct proc*, struct proc*);
+void            mmapexit(struct proc*);
+int             rangefree(struct proc*, uint, uint);
+void            pcacheinit(void);
+void            pcacheinval(struct inode*);
 
 // mp.c
 extern int      ismp;
@@ -99,6 +137,11 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// prof.c
+void            profinit(void);
+int             profintr(struct trapframe*);
+int             prof(int, char*, int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -123,16 +166,41 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeone(void*);
 void            yield(void);
+int             schedtick(void);
+int             setpriority(int, int);
+void            schedstat(struct schedstat*);
+void            kproc(char*, void (*)(void));
+uint            swapvictim(uint);
+
+// swap.c
+void            swapinit(void);
+void            swapdup(uint);
+void            swapfree(uint);
+char*           swapkalloc(void);
+int             swapin(pde_t*, uint);
+void            swapstat(struct swapstat*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+int             shmrm(int);
+uint            shmattach(struct proc*, int, uint);
+int             shmdetach(struct proc*, uint);
+int             shmshrink(struct proc*, uint);
+void            shmfork(struct proc*, struct proc*);
+void            shmexit(struct proc*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(char*, int, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -144,6 +212,7 @@ int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
+uint            avg64(uint64, uint);
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
 void*           memset(void*, int, uint);
@@ -155,9 +224,10 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
+int             argwptr(int, char**, int);
+int             argstr(int, char*, int);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
 
 // timer.c
@@ -166,6 +236,7 @@ void            timerinit(void);
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+extern uint64   tickcycles;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -190,6 +261,17 @@ void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 int             cowfault(pde_t*, uint);
+uint            pageloan(pde_t*, uint);
+int             pagerecv(pde_t*, uint, uint);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+int             allocuvm_ondemand(pde_t*, uint, int);
+int             unmapuvm(pde_t*, uint, uint);
+int             mapzeropage(pde_t*, uint);
+int             maphugepage(pde_t*, uint);
+void            vmcount(int, int);
+void            flushtlb(pde_t*);
+void            vmstat(struct vmstat*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
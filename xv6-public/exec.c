@@ -6,16 +6,22 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "mman.h"
+
+// The program's segments are not read here.  Each one becomes a
+// private region of the executable (see mmap.c), filled in page by
+// page on first touch, and sz covers them as usual.
 
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg, locked;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma seg[NVMA], *v;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -27,6 +33,7 @@ exec(char *path, char **argv)
     return -1;
   }
   ilock(ip);
+  locked = 1;
   pgdir = 0;
 
   // Check ELF header
@@ -38,8 +45,9 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.
   sz = 0;
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -49,16 +57,29 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < sz)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE || nseg == NVMA)
       goto bad;
+    if(ph.memsz == 0)
+      continue;
+    v = &seg[nseg++];
+    v->start = ph.vaddr;
+    v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+    v->prot = PROT_READ;
+    if(ph.flags & ELF_PROG_FLAG_WRITE)
+      v->prot |= PROT_WRITE;
+    v->flags = MAP_PRIVATE;
+    v->f = 0;
+    v->ip = ip;
+    v->off = ph.off;
+    v->fend = ph.vaddr + ph.filesz;
+    sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // Keep our reference to ip for the regions.
+  iunlock(ip);
+  locked = 0;
   end_op();
-  ip = 0;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
@@ -94,6 +115,12 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  mmapexit(curproc);
+  shmexit(curproc);
+  for(i = 0; i < nseg; i++){
+    curproc->vma[i] = seg[i];
+    idup(ip);
+  }
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
@@ -101,14 +128,21 @@ exec(char *path, char **argv)
   curproc->tf->esp = sp;
   switchuvm(curproc);
   freevm(oldpgdir);
+  begin_op();
+  iput(ip);
+  end_op();
   return 0;
 
  bad:
   if(pgdir)
     freevm(pgdir);
-  if(ip){
+  if(locked){
     iunlockput(ip);
     end_op();
+  } else {
+    begin_op();
+    iput(ip);
+    end_op();
   }
   return -1;
 }
@@ -0,0 +1,54 @@
+// Exec benchmark: fork and exec a program that exits at once, n
+// times, the way a shell pipeline starts its tools.  Prints execs
+// per second and the page faults each child took.
+//
+// usage: execbench [n [program]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char *args[3];
+  int n, i, pid, t0, t1;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0){
+    printf(1, "execbench: the child took %d page faults\n", pgfaults());
+    exit();
+  }
+
+  n = argc > 1 ? atoi(argv[1]) : 100;
+  if(n < 1){
+    printf(1, "usage: execbench [n [program]]\n");
+    exit();
+  }
+  args[0] = argc > 2 ? argv[2] : "execbench";
+  args[1] = argc > 2 ? 0 : "-x";
+  args[2] = 0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      printf(1, "execbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      // Only the last child reports its faults.
+      if(i < n - 1)
+        close(1);
+      exec(args[0], args);
+      printf(2, "execbench: exec %s failed\n", args[0]);
+      exit();
+    }
+    wait();
+  }
+  t1 = uptime();
+
+  printf(1, "execbench: %d execs of %s, %d ticks", n, args[0], t1 - t0);
+  if(t1 > t0)
+    printf(1, ", %d execs/sec", n * 100 / (t1 - t0));
+  printf(1, "\n");
+  exit();
+}
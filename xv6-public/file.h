@@ -14,15 +14,22 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *orphan; // next inode for ireclaim(), under icache.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint nextbn;        // block readi() expects next, if sequential
+  uint raend;         // first block not yet read ahead
+  uint mapbn;         // file block of map[0]
+  uint mapn;          // entries in map, 0 if none
+  uint map[NMAPCACHE]; // disk blocks from the last indirect block read
+  int pcached;        // may have pages in mmap.c's page cache
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+NLEVEL];
 };
 
 // table mapping major device number to
@@ -0,0 +1,63 @@
+// Fork latency benchmark.
+// Grows the heap to a series of sizes and times a burst of
+// fork()+exit()+wait() at each size, to show how fork cost
+// scales with the parent's address space.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NFORK  100   // forks timed per size
+#define HZ     100   // timer ticks per second
+
+static int sizes[] = { 0, 16, 256, 1024, 4096 };   // extra heap pages
+
+int
+main(int argc, char *argv[])
+{
+  int s, i, npages, t0, t1, pid, pts;
+  char *p;
+
+  printf(1, "forkbench: %d forks per size\n", NFORK);
+  for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+    npages = sizes[s];
+    p = sbrk(npages * 4096);
+    if(p == (char*)-1){
+      printf(1, "forkbench: sbrk(%d pages) failed\n", npages);
+      break;
+    }
+    for(i = 0; i < npages; i++)
+      p[i * 4096] = i;
+
+    // With SHAREPT the child starts out sharing all user page
+    // table pages, which getptsize() does not count.
+    pts = getptsize();
+    pid = fork();
+    if(pid == 0){
+      printf(1, "size %d KB: pt pages before fork %d, child %d, child pp %d\n",
+             (int)sbrk(0) / 1024, pts, getptsize(), numpp());
+      exit();
+    }
+    wait();
+
+    t0 = uptime();
+    for(i = 0; i < NFORK; i++){
+      pid = fork();
+      if(pid < 0){
+        printf(1, "forkbench: fork failed\n");
+        exit();
+      }
+      if(pid == 0)
+        exit();
+      wait();
+    }
+    t1 = uptime();
+    if(t1 == t0)
+      t1 = t0 + 1;
+    printf(1, "size %d KB: %d forks in %d ticks, %d forks/sec\n",
+           (int)sbrk(0) / 1024, NFORK, t1 - t0,
+           NFORK * HZ / (t1 - t0));
+    sbrk(-npages * 4096);
+  }
+  exit();
+}
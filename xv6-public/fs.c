@@ -22,7 +22,9 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
-static void itrunc(struct inode*);
+static int itrunc(struct inode*);
+static void dcinit(void);
+static void dcpurge(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -166,6 +168,8 @@ bfree(int dev, uint b)
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *orphan;   // unlinked inodes iput() could not free yet
+  int reclaiming;         // an ireclaim() is draining orphan
 } icache;
 
 void
@@ -174,6 +178,7 @@ iinit(int dev)
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  dcinit();
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
   }
@@ -266,6 +271,9 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->nextbn = 0;
+  ip->raend = 0;
+  ip->mapn = 0;
   release(&icache.lock);
 
   return ip;
@@ -305,6 +313,9 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    // Pages cached while it was last in the inode cache may
+    // still be there.
+    ip->pcached = 1;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -338,10 +349,22 @@ iput(struct inode *ip)
     release(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
-      itrunc(ip);
-      ip->type = 0;
-      iupdate(ip);
-      ip->valid = 0;
+      if(ip->type == T_DIR)
+        dcpurge(ip);
+      if(itrunc(ip)){
+        ip->type = 0;
+        iupdate(ip);
+        ip->valid = 0;
+      } else {
+        // Too big to free within the caller's transaction; keep
+        // the reference and let ireclaim() finish it.
+        releasesleep(&ip->lock);
+        acquire(&icache.lock);
+        ip->orphan = icache.orphan;
+        icache.orphan = ip;
+        release(&icache.lock);
+        return;
+      }
     }
   }
   releasesleep(&ip->lock);
@@ -351,6 +374,32 @@ iput(struct inode *ip)
   release(&icache.lock);
 }
 
+// Finish freeing the inodes that iput() left to us, each piece in a
+// transaction of its own.  Called by end_op() once the caller's
+// transaction is over; one caller at a time drains the list.
+void
+ireclaim(void)
+{
+  struct inode *ip;
+
+  acquire(&icache.lock);
+  if(icache.reclaiming){
+    release(&icache.lock);
+    return;
+  }
+  icache.reclaiming = 1;
+  while((ip = icache.orphan) != 0){
+    icache.orphan = ip->orphan;
+    release(&icache.lock);
+    begin_op();
+    iput(ip);
+    end_op();
+    acquire(&icache.lock);
+  }
+  icache.reclaiming = 0;
+  release(&icache.lock);
+}
+
 // Common idiom: unlock, then put.
 void
 iunlockput(struct inode *ip)
@@ -364,39 +413,132 @@ iunlockput(struct inode *ip)
 //
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
-// are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// are listed in ip->addrs[].  The rest are listed in trees of
+// indirect blocks: the next NINDIRECT blocks in the single
+// indirect block ip->addrs[NDIRECT], the next NINDIRECT^2 under
+// the double indirect block ip->addrs[NDIRECT+1], and so on.
+//
+// Looking a block up in the trees reads an indirect block per
+// level, so bmap() remembers NMAPCACHE entries of the last
+// bottom-level indirect block it read in ip->map[]; sequential
+// reads and writes then go to the indirect blocks only once
+// every NMAPCACHE blocks.
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, fbn, n, i;
   struct buf *bp;
+  int level, l;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
       ip->addrs[bn] = addr = balloc(ip->dev);
     return addr;
   }
+  if(bn - ip->mapbn < ip->mapn && (addr = ip->map[bn - ip->mapbn]) != 0)
+    return addr;
+  fbn = bn;
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+  // Find the tree holding bn; n is the number of blocks under it.
+  for(level = 1, n = NINDIRECT; bn >= n; level++, n *= NINDIRECT){
+    if(level == NLEVEL)
+      panic("bmap: out of range");
+    bn -= n;
+  }
+
+  // Walk down it, allocating indirect blocks as necessary.
+  if((addr = ip->addrs[NDIRECT+level-1]) == 0)
+    ip->addrs[NDIRECT+level-1] = addr = balloc(ip->dev);
+  for(l = level; l > 0; l--){
+    n /= NINDIRECT;
+    i = bn / n % NINDIRECT;
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[i]) == 0){
+      a[i] = addr = balloc(ip->dev);
       log_write(bp);
     }
+    if(l == 1){
+      i -= i % NMAPCACHE;
+      memmove(ip->map, a + i, sizeof(ip->map));
+      ip->mapbn = fbn - bn % NMAPCACHE;
+      ip->mapn = NMAPCACHE;
+    }
     brelse(bp);
-    return addr;
   }
+  return addr;
+}
+
+// itrunc() state: freeing a large file touches more blocks than one
+// transaction may write, so itrunc() frees at most max blocks' worth
+// and leaves the rest to later transactions.  Each pointer to a freed
+// block is cleared in the same transaction, so a commit never leaves
+// the inode pointing at free blocks.
+struct trunc {
+  uint dev;
+  uint bblock;    // bitmap block of the last block freed
+  int n;          // blocks written in this transaction
+  int max;        // blocks it may write
+};
+
+// Reserve room in the transaction for one more block write.
+static int
+truncroom(struct trunc *t)
+{
+  if(t->n >= t->max)
+    return 0;
+  t->n++;
+  return 1;
+}
+
+static int
+truncfree(struct trunc *t, uint b)
+{
+  if(BBLOCK(b, sb) != t->bblock){
+    if(!truncroom(t))
+      return 0;
+    t->bblock = BBLOCK(b, sb);
+  }
+  bfree(t->dev, b);
+  return 1;
+}
 
-  panic("bmap: out of range");
+// Free the blocks listed in indirect block addr, which has level
+// levels of blocks below it.  Returns 0 if the transaction filled up
+// first, with what was freed cleared from addr.
+static int
+truncmap(struct trunc *t, uint addr, int level)
+{
+  struct buf *bp;
+  uint *a;
+  int j, dirty, done;
+
+  bp = bread(t->dev, addr);
+  a = (uint*)bp->data;
+  dirty = 0;
+  done = 1;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(!dirty && !truncroom(t)){
+      done = 0;
+      break;
+    }
+    dirty = 1;
+    if((level > 1 && !truncmap(t, a[j], level - 1)) || !truncfree(t, a[j])){
+      done = 0;
+      break;
+    }
+    a[j] = 0;
+  }
+  if(dirty)
+    log_write(bp);
+  brelse(bp);
+  return done;
 }
 
 // Truncate inode (discard contents).
@@ -404,34 +546,35 @@ bmap(struct inode *ip, uint bn)
 // to it (no directory entries referring to it)
 // and has no in-memory reference to it (is
 // not an open file or current directory).
-static void
+// Returns 0 if it freed only part of the file,
+// leaving half the transaction to the caller.
+static int
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
-
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
-    }
-  }
-
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  struct trunc t;
+  int i, done;
+
+  pcacheinval(ip);
+  ip->mapn = 0;
+  t.dev = ip->dev;
+  t.bblock = 0;
+  t.n = 0;
+  t.max = MAXOPBLOCKS/2 - 1;  // and the inode itself
+  done = 1;
+  for(i = NDIRECT+NLEVEL-1; i >= 0; i--){
+    if(ip->addrs[i] == 0)
+      continue;
+    if((i >= NDIRECT && !truncmap(&t, ip->addrs[i], i - NDIRECT + 1)) ||
+       !truncfree(&t, ip->addrs[i])){
+      done = 0;
+      break;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    ip->addrs[i] = 0;
   }
 
   ip->size = 0;
   iupdate(ip);
+  return done;
 }
 
 // Copy stat information from inode.
@@ -446,6 +589,28 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Called before readi() reads block bn of ip.  If reads of ip are
+// sequential, start reading the blocks up to NREADAHEAD past bn
+// without waiting.  Blocks are requested in batches, once half of
+// the previous batch has been consumed, so that the disk can merge
+// them into multi-sector transfers.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint b, nb;
+
+  if(bn != ip->nextbn && bn + 1 != ip->nextbn)
+    ip->raend = 0;  // a seek: start over
+  if(bn > 0 && bn == ip->nextbn && bn + NREADAHEAD/2 >= ip->raend){
+    nb = (ip->size + BSIZE - 1) / BSIZE;
+    for(b = ip->raend > bn ? ip->raend : bn; b < bn + NREADAHEAD && b < nb; b++)
+      bprefetch(ip->dev, bmap(ip, b));
+    ip->raend = b;
+  }
+  ip->nextbn = bn + 1;
+}
+
 //PAGEBREAK!
 // Read data from inode.
 // Caller must hold ip->lock.
@@ -467,9 +632,13 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    readahead(ip, off/BSIZE);
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+    if(copyuser(dst, bp->data + off%BSIZE, m) < 0){
+      brelse(bp);
+      return -1;
+    }
     brelse(bp);
   }
   return n;
@@ -483,6 +652,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  int r;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -495,19 +665,23 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  pcacheinval(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
+    r = copyuser(bp->data + off%BSIZE, src, m);
     log_write(bp);
     brelse(bp);
+    // A fault on src ends the write after the blocks done.
+    if(r < 0)
+      break;
   }
 
-  if(n > 0 && off > ip->size){
+  if(tot > 0 && off > ip->size){
     ip->size = off;
     iupdate(ip);
   }
-  return n;
+  return tot == n ? n : -1;
 }
 
 //PAGEBREAK!
@@ -519,64 +693,236 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+// Name cache.
+//
+// namex() looks every path element up in its directory, and
+// reading a large directory through readi() for each one is slow.
+// The name cache remembers recent lookups, (dev, directory inum,
+// name) -> (inum, offset of the entry), including names that were
+// not found (inum 0).  It is set associative: a key can only live
+// in the NDCWAY entries of set dirhash() % NDCSET, which are
+// replaced round robin.
+//
+// A directory's entries are only read or changed with the
+// directory locked, and dirlink() and dirunlink() keep its cache
+// entries up to date, so an entry is correct while the directory
+// exists; iput() purges them when the directory is freed.
+
+#define NDCWAY 4
+#define NDCSET (NDCACHE / NDCWAY)
+
+struct dcentry {
+  uint dev;
+  uint dinum;           // Directory, 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum;            // 0 if the directory has no such name
+  uint off;             // Offset of the directory entry
+};
+
+struct {
+  struct spinlock lock;
+  struct dcentry ent[NDCSET][NDCWAY];
+  uchar next[NDCSET];   // Way to replace next in each set
+} dcache;
+
+static void
+dcinit(void)
 {
-  uint off, inum;
+  initlock(&dcache.lock, "dcache");
+}
+
+// FNV-1a hash of a name, for the name cache and hashed directories.
+// mkfs has a copy; the two must agree.
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Find the cache entry for name in dp.  Caller holds dcache.lock.
+static struct dcentry*
+dcfind(struct inode *dp, char *name)
+{
+  struct dcentry *e, *set;
+
+  set = dcache.ent[(dirhash(name) ^ dp->inum) % NDCSET];
+  for(e = set; e < set + NDCWAY; e++)
+    if(e->dinum == dp->inum && e->dev == dp->dev && namecmp(e->name, name) == 0)
+      return e;
+  return 0;
+}
+
+// Look name up in the cache.  Returns 1 and sets *pinum (0 if dp
+// has no such name) and *poff if it is there, 0 if not.
+static int
+dcget(struct inode *dp, char *name, uint *pinum, uint *poff)
+{
+  struct dcentry *e;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp, name)) != 0){
+    *pinum = e->inum;
+    *poff = e->off;
+  }
+  release(&dcache.lock);
+  return e != 0;
+}
+
+// Remember that name in dp is inum at offset off (or, if inum is 0,
+// that there is no name in dp).
+static void
+dcput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dcentry *e;
+  uint s;
+
+  acquire(&dcache.lock);
+  if((e = dcfind(dp, name)) == 0){
+    s = (dirhash(name) ^ dp->inum) % NDCSET;
+    e = &dcache.ent[s][dcache.next[s]];
+    dcache.next[s] = (dcache.next[s] + 1) % NDCWAY;
+    e->dev = dp->dev;
+    e->dinum = dp->inum;
+    strncpy(e->name, name, DIRSIZ);
+  }
+  e->inum = inum;
+  e->off = off;
+  release(&dcache.lock);
+}
+
+// Forget every name in dp, which is being freed.
+static void
+dcpurge(struct inode *dp)
+{
+  struct dcentry *e;
+  int s;
+
+  acquire(&dcache.lock);
+  for(s = 0; s < NDCSET; s++)
+    for(e = dcache.ent[s]; e < dcache.ent[s] + NDCWAY; e++)
+      if(e->dinum == dp->inum && e->dev == dp->dev)
+        e->dinum = 0;
+  release(&dcache.lock);
+}
+
+// Search directory dp for name.  Returns its inum and sets *poff to
+// the offset of its entry, or returns 0 and sets *poff to where
+// dirlink() should put it: a free entry, or dp->size if there is
+// none.
+static uint
+dirscan(struct inode *dp, char *name, uint *poff)
+{
+  uint off, free, b, nb, i;
   struct dirent de;
 
-  if(dp->type != T_DIR)
-    panic("dirlookup not DIR");
+  free = dp->size;
+  if(dp->major == DIRHASHED && dp->size >= BSIZE){
+    nb = dp->size / BSIZE;
+    b = dirhash(name) % nb;
+    for(i = 0; i < nb; i++, b = (b + 1) % nb){
+      for(off = b*BSIZE; off < (b+1)*BSIZE; off += sizeof(de)){
+        if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+          panic("dirscan read");
+        if(de.inum == 0){
+          if(free == dp->size)
+            free = off;
+          if(de.name[0] == 0)  // never used: name is not further on
+            goto out;
+          continue;
+        }
+        if(namecmp(name, de.name) == 0){
+          *poff = off;
+          return de.inum;
+        }
+      }
+    }
+    goto out;
+  }
 
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
+      panic("dirscan read");
+    if(de.inum == 0){
+      if(free == dp->size)
+        free = off;
       continue;
+    }
     if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+      *poff = off;
+      return de.inum;
     }
   }
-
+out:
+  *poff = free;
   return 0;
 }
 
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off, inum;
+
+  if(dp->type != T_DIR)
+    panic("dirlookup not DIR");
+
+  if(!dcget(dp, name, &inum, &off)){
+    inum = dirscan(dp, name, &off);
+    dcput(dp, name, inum, inum ? off : 0);
+  }
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  uint off;
   struct dirent de;
-  struct inode *ip;
 
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  // Check that name is not present, and find a place for it.
+  if(dirscan(dp, name, &off) != 0)
+    return -1;
+  // A hashed directory does not grow.
+  if(dp->major == DIRHASHED && off >= dp->size)
     return -1;
-  }
-
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
-  }
 
+  memset(&de, 0, sizeof(de));
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcput(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, at offset off, from directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  // In a hashed directory the name must stay.
+  if(dp->major == DIRHASHED)
+    strncpy(de.name, name, DIRSIZ);
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink");
+  dcput(dp, name, 0, 0);
+}
+
 //PAGEBREAK!
 // Paths
 
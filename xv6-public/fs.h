@@ -7,7 +7,7 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                                free bit map | data blocks | swap]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -19,11 +19,19 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks, after the file system
 };
 
-#define NDIRECT 12
+// A file's blocks are listed in NDIRECT direct entries, then in a
+// tree of indirect blocks NLEVEL levels deep: addrs[NDIRECT] is a
+// single indirect block, addrs[NDIRECT+1] a double indirect block
+// and addrs[NDIRECT+2] a triple indirect block.
+#define NDIRECT 10
+#define NLEVEL 3
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT + \
+                 NINDIRECT*NINDIRECT*NINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,7 +40,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+NLEVEL];   // Data block addresses
 };
 
 // Inodes per block.
@@ -55,3 +63,12 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory whose major number is DIRHASHED has a fixed number
+// of blocks, and keeps the entry for a name in block
+// dirhash(name) % nblocks, or in the next block after it (wrapping
+// around) with room.  A lookup stops at the first entry that was
+// never used; removed entries keep their names so that the names
+// stored past them can still be found.  mkfs -d n makes the root
+// directory a hashed one of n blocks.
+#define DIRHASHED 1
+
@@ -23,13 +23,19 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+
+#define IDE_MAXMULT   16  // most sectors in one multi-sector transfer
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
+// The first idenbuf bufs of the queue are for consecutive blocks
+// and are being transferred together by one multi-sector command.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static int idenbuf;
 
 static int havedisk1;
 static void idestart(struct buf*);
@@ -65,37 +71,67 @@ ideinit(void)
     }
   }
 
+  // Let READ/WRITE MULTIPLE move up to IDE_MAXMULT sectors per
+  // interrupt.  The completion interrupt finds idequeue empty.
+  for(i = 0; i <= havedisk1; i++){
+    outb(0x1f6, 0xe0 | (i<<4));
+    idewait(0);
+    outb(0x1f2, IDE_MAXMULT);
+    outb(0x1f7, IDE_CMD_SETMUL);
+    idewait(0);
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Can b be transferred by the same command as a, right after it?
+static int
+idemergeable(struct buf *a, struct buf *b)
+{
+  return b->dev == a->dev && b->blockno == a->blockno + 1 &&
+    (b->flags & B_DIRTY) == (a->flags & B_DIRTY);
+}
+
+// Start the request for b, together with the requests queued
+// behind it for the following blocks.  Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
+  struct buf *nb;
+  int n, nsect;
+
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + NSWAP)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
-  int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
-  int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (sector_per_block > IDE_MAXMULT) panic("idestart");
+
+  n = 1;
+  for(nb = b; nb->qnext && idemergeable(nb, nb->qnext); nb = nb->qnext){
+    if((n+1) * sector_per_block > IDE_MAXMULT)
+      break;
+    n++;
+  }
+  idenbuf = n;
+  nsect = n * sector_per_block;
 
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, nsect);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outb(0x1f7, nsect == 1 ? IDE_CMD_WRITE : IDE_CMD_WRMUL);
+    for(nb = b; n-- > 0; nb = nb->qnext)
+      outsl(0x1f0, nb->data, BSIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(0x1f7, nsect == 1 ? IDE_CMD_READ : IDE_CMD_RDMUL);
   }
 }
 
@@ -103,41 +139,59 @@ idestart(struct buf *b)
 void
 ideintr(void)
 {
-  struct buf *b;
+  struct buf *b, *done;
+  int read;
 
-  // First queued buffer is the active request.
+  // First idenbuf queued buffers are the active request.
   acquire(&idelock);
 
   if((b = idequeue) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  read = !(b->flags & B_DIRTY) && idewait(1) >= 0;
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  done = 0;
+  for(; idenbuf > 0; idenbuf--){
+    b = idequeue;
+    idequeue = b->qnext;
+    if(read)
+      insl(0x1f0, b->data, BSIZE/4);
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    if(b->flags & B_ASYNC){
+      // Nobody is waiting; finish up below, without idelock.
+      b->flags &= ~B_ASYNC;
+      b->qnext = done;
+      done = b;
+    } else {
+      // Wake process waiting for this buf.
+      wakeup(b);
+    }
+  }
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
     idestart(idequeue);
 
   release(&idelock);
+
+  for(; done; done = b){
+    b = done->qnext;
+    bdone(done);
+  }
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Add b to idequeue and start the disk if it is idle.
+// Caller must hold idelock.
+static void
+idequeueadd(struct buf *b)
 {
   struct buf **pp;
+  int i;
 
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
@@ -146,17 +200,33 @@ iderw(struct buf *b)
   if(b->dev != 0 && !havedisk1)
     panic("iderw: ide disk 1 not present");
 
-  acquire(&idelock);  //DOC:acquire-lock
-
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
+  // Append b to idequeue, unless a waiting request is for the block
+  // before b: then queue b right behind it, so the two can be merged.
+  pp = &idequeue;
+  for(i = 0; *pp && i < idenbuf; i++)  // skip the active request
+    pp = &(*pp)->qnext;
+  for(; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+    if(idemergeable(*pp, b)){
+      pp = &(*pp)->qnext;
+      break;
+    }
+  b->qnext = *pp;
   *pp = b;
 
   // Start disk if necessary.
   if(idequeue == b)
     idestart(b);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+iderw(struct buf *b)
+{
+  acquire(&idelock);  //DOC:acquire-lock
+
+  idequeueadd(b);
 
   // Wait for request to finish.
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
@@ -166,3 +236,31 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Like iderw, for the n bufs b[0..n-1] at once, so that requests
+// for consecutive blocks reach the disk together.
+void
+iderwv(struct buf *b, int n)
+{
+  int i;
+
+  acquire(&idelock);
+  for(i = 0; i < n; i++)
+    idequeueadd(&b[i]);
+  for(i = 0; i < n; i++)
+    while((b[i].flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(&b[i], &idelock);
+  release(&idelock);
+}
+
+// Like iderw, but return at once.  b must have B_ASYNC set;
+// ideintr() passes it to bdone() when the transfer is over.
+void
+ideasync(struct buf *b)
+{
+  if(!(b->flags & B_ASYNC))
+    panic("ideasync");
+  acquire(&idelock);
+  idequeueadd(b);
+  release(&idelock);
+}
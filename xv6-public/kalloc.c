@@ -1,10 +1,17 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Free pages live in a global pool (kmem) fronted by a small
+// per-CPU cache (kcache).  kalloc()/kfree() normally touch only
+// the local cache with interrupts off; the global lock is taken
+// once per KCACHE_BATCH pages to refill or drain it.  When both
+// are empty, kalloc() takes a page from another CPU's cache.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
@@ -21,17 +28,45 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;                   // Pages on the global freelist
 } kmem;
 
+// Per-CPU free page cache.  Used by its own CPU with interrupts
+// disabled, and by other CPUs only when memory runs out, so its
+// plain xchg lock is almost never contended.
+#define KCACHE_BATCH  32       // pages moved per refill/drain
+#define KCACHE_MAX    (2*KCACHE_BATCH)
+
+struct kcache {
+  uint locked;
+  struct run *freelist;
+  int nfree;
+} kcache[NCPU];
+
+static void
+kcache_lock(struct kcache *c)
+{
+  while(xchg(&c->locked, 1) != 0)
+    ;
+}
+
+static void
+kcache_unlock(struct kcache *c)
+{
+  xchg(&c->locked, 0);
+}
+
 // Reference count for each physical page
 // Indexed by physical page number (pa / PGSIZE)
-// We need to track pages from 0 to PHYSTOP
+// We need to track pages from 0 to PHYSTOP.
+// Counts are updated with atomic instructions, not a lock.
 #define MAX_PAGES ((PHYSTOP) / PGSIZE)
-static int refcount[MAX_PAGES];
-static struct spinlock refcount_lock;
+static volatile int refcount[MAX_PAGES];
 
-// Track number of free pages
-static int num_free_pages;
+// A page of zeros that read faults on anonymous memory map
+// read-only.  It holds one reference of its own, so it is never
+// freed; writes copy it through cowfault().
+char *zeropage;
 
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
@@ -42,19 +77,37 @@ void
 kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
-  initlock(&refcount_lock, "refcount");
   kmem.use_lock = 0;
-  // Static arrays are zero-initialized by default, but explicitly zero for clarity
-  // Only initialize the portion we'll actually use to avoid issues
-  num_free_pages = 0;
+  kmem.nfree = 0;
   freerange(vstart, vend);
 }
 
+// Reserve of 4MB frames for MAP_HUGE regions.  Once memory is
+// handed out page by page it is rarely contiguous again, so kinit2()
+// keeps aligned frames at the top of memory aside: one for every
+// HUGEFRAC frames of memory, up to NHUGEPAGE.
+#define HUGEFRAC 16
+
+struct {
+  struct spinlock lock;
+  uint base;                   // Physical address of the first frame
+  int n;                       // Frames in the reserve
+  int used[NHUGEPAGE];         // 1 if the frame is mapped
+} khuge;
+
 void
 kinit2(void *vstart, void *vend)
 {
-  freerange(vstart, vend);
+  initlock(&khuge.lock, "khuge");
+  khuge.n = (V2P(vend) - V2P(vstart)) / (HUGEFRAC*HUGEPGSIZE);
+  if(khuge.n > NHUGEPAGE)
+    khuge.n = NHUGEPAGE;
+  khuge.base = (V2P(vend) & ~(HUGEPGSIZE-1)) - khuge.n*HUGEPGSIZE;
+  freerange(vstart, khuge.n ? P2V(khuge.base) : vend);
   kmem.use_lock = 1;
+  if((zeropage = kalloc()) == 0)
+    panic("kinit2: zeropage");
+  memset(zeropage, 0, PGSIZE);
 }
 
 void
@@ -75,11 +128,12 @@ freerange(void *vstart, void *vend)
     r = (struct run*)p;
     r->next = kmem.freelist;
     kmem.freelist = r;
-    num_free_pages++;
+    kmem.nfree++;
     if(kmem.use_lock)
       release(&kmem.lock);
   }
 }
+
 // Get reference count for a physical page
 int
 getrefcount(uint pa)
@@ -89,10 +143,7 @@ getrefcount(uint pa)
     panic("getrefcount: index out of range");
   if(!kmem.use_lock)
     return 0; // Not tracking refcounts during early boot
-  acquire(&refcount_lock);
-  int count = refcount[idx];
-  release(&refcount_lock);
-  return count;
+  return refcount[idx];
 }
 
 // Increment reference count for a physical page
@@ -104,18 +155,11 @@ incref(uint pa)
     panic("incref: index out of range");
   if(!kmem.use_lock)
     return; // Not tracking refcounts during early boot
-  acquire(&refcount_lock);
-  // Increment reference count for the child process
-  // If refcount is 0, it means the page was allocated before tracking was enabled
-  // In that case, initialize to 1 (parent) then increment to 2 (parent + child)
-  // If refcount is 1 (from kalloc), increment to 2 (parent + child)
-  if(refcount[idx] == 0) {
-    // Page was never tracked - set to 1 (parent's reference)
-    refcount[idx] = 1;
-  }
-  // Now increment for child's reference (makes it 2: parent + child)
-  refcount[idx]++;
-  release(&refcount_lock);
+  // If refcount is 0, the page was allocated before tracking was
+  // enabled: count the existing (parent) reference first, so the
+  // increment below makes it 2 (parent + child).
+  __sync_bool_compare_and_swap(&refcount[idx], 0, 1);
+  __sync_fetch_and_add(&refcount[idx], 1);
 }
 
 // Decrement reference count for a physical page
@@ -125,21 +169,61 @@ int
 decref(uint pa)
 {
   uint idx = pa / PGSIZE;
+  int old;
+
   if(idx >= MAX_PAGES)
     panic("decref: index out of range");
   if(!kmem.use_lock)
     return 0; // Not tracking refcounts during early boot, assume can free
-  acquire(&refcount_lock);
-  if(refcount[idx] <= 0) {
-    // Already zero - might be a double-free or page never allocated
-    // Return 0 to indicate it's already free
-    release(&refcount_lock);
-    return 0;
+  do {
+    old = refcount[idx];
+    if(old <= 0)
+      return 0;   // Already zero - double free or never allocated
+  } while(!__sync_bool_compare_and_swap(&refcount[idx], old, old - 1));
+  return old - 1;
+}
+
+// Move up to n pages from the global pool into c.
+// Called with interrupts off on c's CPU, holding c's lock.
+static void
+kcache_refill(struct kcache *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
   }
-  refcount[idx]--;
-  int count = refcount[idx];
-  release(&refcount_lock);
-  return count;
+  release(&kmem.lock);
+}
+
+// Return n pages from c to the global pool.
+// Called with interrupts off on c's CPU, holding c's lock.
+static void
+kcache_drain(struct kcache *c, int n)
+{
+  struct run *head, *tail;
+  int i;
+
+  if(n <= 0 || c->freelist == 0)
+    return;
+  // Detach the chain first so the global lock is held only
+  // for the splice.
+  head = tail = c->freelist;
+  for(i = 1; i < n && tail->next; i++)
+    tail = tail->next;
+  c->freelist = tail->next;
+  c->nfree -= i;
+
+  acquire(&kmem.lock);
+  tail->next = kmem.freelist;
+  kmem.freelist = head;
+  kmem.nfree += i;
+  release(&kmem.lock);
 }
 
 //PAGEBREAK: 21
@@ -151,33 +235,60 @@ void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *c;
   uint pa = V2P(v);
 
   if((uint)v % PGSIZE || v < end || pa >= PHYSTOP)
     panic("kfree");
 
-  // Decrement reference count (only if in valid range and after full init)
-  uint idx = pa / PGSIZE;
-  int ref = 0;
-  if(idx < MAX_PAGES && kmem.use_lock) {
-    // Only use refcount tracking after full initialization
-    ref = decref(pa);
-    // Only actually free if refcount is zero
-    if(ref > 0)
-      return;
-  }
-  
+  // Only actually free if this was the last reference.
+  if(kmem.use_lock && decref(pa) > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  num_free_pages++;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+    return;
+  }
+
+  pushcli();
+  c = &kcache[cpuid()];
+  kcache_lock(c);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  if(c->nfree > KCACHE_MAX)
+    kcache_drain(c, KCACHE_BATCH);
+  kcache_unlock(c);
+  popcli();
+}
+
+// Take a page from another CPU's cache, once this CPU's cache
+// and the global pool are both empty.  Called with interrupts off.
+static struct run*
+kcache_steal(struct kcache *self)
+{
+  struct kcache *c;
+  struct run *r;
+
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    if(c == self || *(volatile int*)&c->nfree == 0)
+      continue;
+    kcache_lock(c);
+    if((r = c->freelist) != 0){
+      c->freelist = r->next;
+      c->nfree--;
+    }
+    kcache_unlock(c);
+    if(r)
+      return r;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -187,51 +298,99 @@ char*
 kalloc(void)
 {
   struct run *r;
-  uint pa;
+  struct kcache *c;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r) {
-    kmem.freelist = r->next;
-    num_free_pages--;
-  }
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  
-  if(r) {
-    pa = V2P((char*)r);
-    // Set reference count to 1 for newly allocated page
-    // Always set refcount if tracking is enabled (kmem.use_lock == 1)
-    uint idx = pa / PGSIZE;
-    if(idx < MAX_PAGES) {
-      if(kmem.use_lock) {
-        // Tracking is enabled - set refcount to 1
-        acquire(&refcount_lock);
-        // If refcount is already set (shouldn't happen for a free page), don't overwrite
-        // But for a newly allocated page from freelist, it should be 0
-        if(refcount[idx] == 0) {
-          refcount[idx] = 1;
-        }
-        release(&refcount_lock);
-      }
-      // If tracking is not enabled yet, refcount stays 0 (will be handled by incref)
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.nfree--;
     }
+    // Refcount stays 0 during early boot (will be handled by incref)
+    return (char*)r;
+  }
+
+  pushcli();
+  c = &kcache[cpuid()];
+  kcache_lock(c);
+  if(c->freelist == 0)
+    kcache_refill(c, KCACHE_BATCH);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
   }
-  
+  kcache_unlock(c);
+  if(r == 0)
+    r = kcache_steal(c);
+  popcli();
+
+  if(r == 0)
+    return 0;
+
+  // A page fresh off a freelist has no other references.
+  refcount[V2P((char*)r) / PGSIZE] = 1;
   return (char*)r;
 }
 
-// Get the number of free pages in the system
+// Get the number of free pages in the system: the global pool
+// plus whatever is parked in the per-CPU caches.  The per-CPU
+// counts are read without synchronization, so the result is a
+// snapshot that may be slightly stale while other CPUs allocate.
 int
 getNumFreePages(void)
 {
-  int count;
+  int i, count;
+
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  count = num_free_pages;
+  count = kmem.nfree;
   if(kmem.use_lock)
     release(&kmem.lock);
+  for(i = 0; i < NCPU; i++)
+    count += *(volatile int*)&kcache[i].nfree;
   return count;
 }
 
+// Allocate one 4MB frame from the reserve.  The caller must
+// zero it.  Returns 0 if the reserve is used up.
+char*
+khugealloc(void)
+{
+  int i;
+
+  acquire(&khuge.lock);
+  for(i = 0; i < khuge.n; i++){
+    if(!khuge.used[i]){
+      khuge.used[i] = 1;
+      release(&khuge.lock);
+      return P2V(khuge.base + i*HUGEPGSIZE);
+    }
+  }
+  release(&khuge.lock);
+  return 0;
+}
+
+static int
+khugeslot(char *v)
+{
+  uint pa = V2P(v);
+
+  if(pa < khuge.base || pa % HUGEPGSIZE ||
+     pa >= khuge.base + khuge.n*HUGEPGSIZE)
+    panic("khuge");
+  return (pa - khuge.base) / HUGEPGSIZE;
+}
+
+// Return the 4MB frame v to the reserve.
+void
+khugefree(char *v)
+{
+  int i = khugeslot(v);
+
+  acquire(&khuge.lock);
+  if(!khuge.used[i])
+    panic("khugefree");
+  khuge.used[i] = 0;
+  release(&khuge.lock);
+}
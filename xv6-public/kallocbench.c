@@ -0,0 +1,73 @@
+// Physical page allocator stress benchmark.
+// Runs 1..N concurrent workers that each grow and shrink their
+// heap with sbrk(), so every page goes through kalloc()/kfree().
+// Reports aggregate pages/sec for each worker count; run with
+// "make qemu CPUS=8" to see how the allocator scales.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NPAGES   64    // pages per sbrk() burst
+#define ROUNDS   200   // bursts per worker
+#define HZ       100   // timer ticks per second
+
+static void
+worker(void)
+{
+  char *p;
+  int r, i;
+
+  for(r = 0; r < ROUNDS; r++){
+    p = sbrk(NPAGES * 4096);
+    if(p == (char*)-1){
+      printf(1, "kallocbench: sbrk failed\n");
+      exit();
+    }
+    for(i = 0; i < NPAGES; i++)
+      p[i * 4096] = r;
+    sbrk(-NPAGES * 4096);
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxw, n, i, t0, t1, pages, free0;
+
+  maxw = 8;
+  if(argc > 1)
+    maxw = atoi(argv[1]);
+  if(maxw < 1)
+    maxw = 1;
+
+  printf(1, "kallocbench: %d pages x %d rounds per worker\n",
+         NPAGES, ROUNDS);
+  free0 = getNumFreePages();
+  for(n = 1; n <= maxw; n++){
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf(1, "kallocbench: fork failed\n");
+        exit();
+      }
+      if(pid == 0)
+        worker();
+    }
+    for(i = 0; i < n; i++)
+      wait();
+    t1 = uptime();
+    if(t1 == t0)
+      t1 = t0 + 1;
+    pages = 2 * n * NPAGES * ROUNDS;   // one kalloc + one kfree each
+    printf(1, "workers %d: %d pages in %d ticks, %d pages/sec\n",
+           n, pages, t1 - t0, pages * HZ / (t1 - t0));
+  }
+  if(getNumFreePages() != free0)
+    printf(1, "kallocbench: free pages %d -> %d (leak?)\n",
+           free0, getNumFreePages());
+  printf(1, "kallocbench done\n");
+  exit();
+}
@@ -40,6 +40,7 @@
 #define TICR    (0x0380/4)   // Timer Initial Count
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
+#define TICKCOUNT 10000000   // Timer counts per clock tick
 
 volatile uint *lapic;  // Initialized in mp.c
 
@@ -66,7 +67,7 @@ lapicinit(void)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, TICKCOUNT);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -105,6 +106,14 @@ lapicid(void)
   return lapic[ID] >> 24;
 }
 
+// Make this CPU's timer interrupt n times per clock tick.
+void
+lapictimer(int n)
+{
+  if(lapic)
+    lapicw(TICR, TICKCOUNT / n);
+}
+
 // Acknowledge interrupt.
 void
 lapiceoi(void)
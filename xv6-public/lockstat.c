@@ -0,0 +1,63 @@
+// Print spin lock statistics, most waited-for lock first.  Given a
+// command, clear the statistics, run it and report only what it
+// caused, e.g. "lockstat forkbench" after "make CPUS=8 qemu".
+//
+// usage: lockstat [-r | command [args...]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockstat st[NLOCKSTAT];
+
+void
+pad(char *s, int w)
+{
+  printf(1, "%s", s);
+  for(w -= strlen(s); w > 0; w--)
+    printf(1, " ");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int n, i, j;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    lockstat(st, 0, 1);
+    exit();
+  }
+  if(argc > 1){
+    lockstat(st, 0, 1);
+    if(fork() == 0){
+      exec(argv[1], argv + 1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  if((n = lockstat(st, NLOCKSTAT, 0)) < 0){
+    printf(2, "lockstat: failed\n");
+    exit();
+  }
+  for(i = 1; i < n; i++)
+    for(j = i; j > 0 && st[j].kwait > st[j-1].kwait; j--){
+      t = st[j];
+      st[j] = st[j-1];
+      st[j-1] = t;
+    }
+
+  printf(1, "name            acquires   contended  kcycles-wait  kcycles-held\n");
+  for(i = 0; i < n; i++){
+    if(st[i].nacquire == 0)
+      continue;
+    pad(st[i].name, 16);
+    printf(1, "%d  %d (%d%%)  %d  %d\n", st[i].nacquire, st[i].ncontended,
+           st[i].ncontended * 100 / st[i].nacquire, st[i].kwait, st[i].khold);
+  }
+  exit();
+}
@@ -0,0 +1,10 @@
+// Spin lock statistics for one lock name, returned by lockstat().
+// Locks with the same name (every pipe's lock, say) are counted
+// together.  Cycle counts are in units of 1024 cycles.
+struct lockstat {
+  char name[16];
+  uint nacquire;    // Acquisitions
+  uint ncontended;  // Acquisitions that had to wait for the lock
+  uint kwait;       // Cycles spent waiting for the lock
+  uint khold;       // Cycles the lock was held
+};
@@ -5,6 +5,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -20,6 +21,11 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// Group commit: when the last outstanding end_op() finds that its
+// transaction already holds several operations, it first yields
+// the CPU, so that other processes can begin operations that join
+// the same transaction instead of paying for a commit of their own.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -27,7 +33,9 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// The number of log blocks is chosen by mkfs (-l).  Log appends
+// are started together and merged by the disk driver; commit()
+// waits for all of them before writing the header.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -40,10 +48,14 @@ struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // data blocks the log can hold
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int nops;        // operations in the current transaction
+  int nsleep;      // begin_op()s sleeping on &log
   int dev;
   struct logheader lh;
+  struct logstat stat;
 };
 struct log log;
 
@@ -53,7 +65,7 @@ static void commit();
 void
 initlog(int dev)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   struct superblock sb;
@@ -61,24 +73,33 @@ initlog(int dev)
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
+  log.cap = log.size - 1 < LOGSIZE ? log.size - 1 : LOGSIZE;
+  if (log.cap < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// After a commit the cache already holds the new contents, pinned;
+// only recovery has to read them from the log.
 static void
-install_trans(void)
+install_trans(int recovering)
 {
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+    if (recovering) {
+      struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
+      memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
+      brelse(lbuf);
+    }
+    bawrite(dbuf);  // start writing dst to disk
   }
+  // Wait for the writes, which the disk may merge, to finish.
+  for (tail = 0; tail < log.lh.n; tail++)
+    brelse(bread(log.dev, log.lh.block[tail]));
 }
 
 // Read the log header from disk into the in-memory log header
@@ -116,11 +137,29 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(); // if committed, copy from log to disk
+  install_trans(1); // if committed, copy from log to disk
   log.lh.n = 0;
   write_head(); // clear the log
 }
 
+// begin_op() waiters are woken one at a time rather than all at
+// once, since usually not all of them can go.  Caller holds
+// log.lock.
+static void
+logsleep(void)
+{
+  log.nsleep++;
+  sleep(&log, &log.lock);
+  log.nsleep--;
+}
+
+static void
+logwakeup(void)
+{
+  if(log.nsleep > 0)
+    wakeone(&log);
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
@@ -128,12 +167,16 @@ begin_op(void)
   acquire(&log.lock);
   while(1){
     if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+      logsleep();
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.cap){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      log.stat.nwait++;
+      logsleep();
     } else {
       log.outstanding += 1;
+      log.nops += 1;
+      // Pass the wakeup on, in case the next one fits too.
+      logwakeup();
       release(&log.lock);
       break;
     }
@@ -149,16 +192,26 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.stat.nop++;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 && log.nops > 1 &&
+     log.lh.n + 2*MAXOPBLOCKS <= log.cap){
+    // Let others join this transaction first.  They commit it
+    // if they begin an operation while we are away.
+    log.nops = 0;
+    release(&log.lock);
+    yield();
+    acquire(&log.lock);
+  }
+  if(log.outstanding == 0 && !log.committing){
     do_commit = 1;
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
-    wakeup(&log);
+    logwakeup();
   }
   release(&log.lock);
 
@@ -168,9 +221,12 @@ end_op(void)
     commit();
     acquire(&log.lock);
     log.committing = 0;
-    wakeup(&log);
+    logwakeup();
     release(&log.lock);
   }
+
+  // Free what iput() had no room for in this transaction.
+  ireclaim();
 }
 
 // Copy modified blocks from cache to log.
@@ -180,13 +236,16 @@ write_log(void)
   int tail;
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    struct buf *to = bnew(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bawrite(to);  // start writing the log
     brelse(from);
-    brelse(to);
   }
+  // The log blocks are consecutive, so the disk writes them in a
+  // few multi-sector transfers.  Wait for all of them.
+  for (tail = 0; tail < log.lh.n; tail++)
+    brelse(bread(log.dev, log.start+tail+1));
 }
 
 static void
@@ -195,8 +254,11 @@ commit()
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
+    install_trans(0); // Now install writes to home locations
+    log.stat.ncommit++;
+    log.stat.nblocks += log.lh.n;
     log.lh.n = 0;
+    log.nops = 0;
     write_head();    // Erase the transaction from the log
   }
 }
@@ -215,7 +277,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -232,3 +294,12 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// Copy the log statistics to *st.
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  st->cap = log.cap;
+  release(&log.lock);
+}
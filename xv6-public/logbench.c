@@ -0,0 +1,82 @@
+// Log benchmark: nproc processes each create, write and delete
+// nfiles small files at once, as usertests' createdelete does.
+// Prints file system operations per second and how many log
+// commits they needed.  Try "make NLOG=n" for other log sizes.
+//
+// usage: logbench [nproc [nfiles]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "bstat.h"
+
+void
+worker(int w, int nfiles)
+{
+  char name[8], data[64];
+  int i, fd;
+
+  memset(data, 'a' + w, sizeof(data));
+  name[0] = 'l';
+  name[1] = 'b';
+  name[2] = '0' + w;
+  name[5] = 0;
+  for(i = 0; i < nfiles; i++){
+    name[3] = '0' + i / 10;
+    name[4] = '0' + i % 10;
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf(1, "logbench: create %s failed\n", name);
+      exit();
+    }
+    write(fd, data, sizeof(data));
+    close(fd);
+  }
+  for(i = 0; i < nfiles; i++){
+    name[3] = '0' + i / 10;
+    name[4] = '0' + i % 10;
+    if(unlink(name) < 0){
+      printf(1, "logbench: unlink %s failed\n", name);
+      exit();
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct logstat s0, s1;
+  int nproc, nfiles, w, t0, t1, ops, commits;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 4;
+  nfiles = argc > 2 ? atoi(argv[2]) : 50;
+  if(nproc < 1 || nproc > 10 || nfiles < 1 || nfiles > 100){
+    printf(1, "usage: logbench [nproc(1-10) [nfiles(1-100)]]\n");
+    exit();
+  }
+
+  logstat(&s0);
+  t0 = uptime();
+  for(w = 0; w < nproc; w++)
+    if(fork() == 0){
+      worker(w, nfiles);
+      exit();
+    }
+  for(w = 0; w < nproc; w++)
+    wait();
+  t1 = uptime();
+  logstat(&s1);
+
+  ops = s1.nop - s0.nop;
+  commits = s1.ncommit - s0.ncommit;
+  printf(1, "logbench: %d procs x %d files, log holds %d blocks\n",
+         nproc, nfiles, s1.cap);
+  printf(1, "%d ops, %d commits (%d ops per 10 commits), %d blocks logged, %d waits\n",
+         ops, commits, commits ? ops * 10 / commits : 0,
+         s1.nblocks - s0.nblocks, s1.nwait - s0.nwait);
+  if(t1 > t0)
+    printf(1, "%d ticks, %d ops/sec\n", t1 - t0, ops * 100 / (t1 - t0));
+  else
+    printf(1, "0 ticks\n");
+  exit();
+}
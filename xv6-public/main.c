@@ -28,12 +28,16 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
-  binit();         // buffer cache
+  profinit();      // sampling profiler
   fileinit();      // file table
+  shminit();       // shared-memory segments
+  pcacheinit();    // page cache for private file mappings
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  binit();         // buffer cache, sized from free memory
   userinit();      // first user process
+  swapinit();      // page-out daemon
   mpmain();        // finish this processor's setup
 }
 
@@ -58,3 +58,15 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk is synchronous, so asynchronous requests
+// complete before returning.
+void
+ideasync(struct buf *b)
+{
+  if(!(b->flags & B_ASYNC))
+    panic("ideasync");
+  iderw(b);
+  b->flags &= ~B_ASYNC;
+  bdone(b);
+}
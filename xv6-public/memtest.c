@@ -2,6 +2,83 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "mman.h"
+
+#define PGSIZE      4096
+#define HUGEPGSIZE  (4*1024*1024)
+
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+// Average cycles per fork+exit+wait.  fork builds the child's page
+// table with setupkvm(), which the kernel's 4MB pages keep small.
+uint
+forkcycles(int n)
+{
+  uint64 t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++){
+    if(fork() == 0)
+      exit();
+    wait();
+  }
+  return (uint)(rdtsc() - t0) / n;
+}
+
+// Average cycles per load when touching one word in each 4KB page
+// of [p, p+len) round after round.  With 4KB pages this misses the
+// TLB every time; with 4MB pages it hardly ever does.
+uint
+touchcycles(char *p, int len, int rounds)
+{
+  uint64 t0;
+  int i, r;
+  volatile int sum;
+
+  sum = 0;
+  for(i = 0; i < len; i += PGSIZE)
+    p[i] = 1;
+  t0 = rdtsc();
+  for(r = 0; r < rounds; r++)
+    for(i = 0; i < len; i += PGSIZE)
+      sum += p[i];
+  return (uint)(rdtsc() - t0) / (rounds * (len / PGSIZE));
+}
+
+// Compare TLB behaviour of 4KB and MAP_HUGE 4MB pages.
+void
+hugetest(void)
+{
+  char *small, *huge;
+  int pts;
+
+  printf(1, "\nTest 4: 4MB pages\n");
+  printf(1, "fork+wait: %d cycles\n", forkcycles(20));
+
+  small = mmap(0, HUGEPGSIZE, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  pts = getptsize();
+  huge = mmap(0, HUGEPGSIZE, PROT_READ|PROT_WRITE,
+              MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGE, -1, 0);
+  if(small == 0 || huge == 0){
+    printf(1, "mmap failed\n");
+    return;
+  }
+  printf(1, "4KB pages: %d cycles per access\n", touchcycles(small, HUGEPGSIZE, 20));
+  printf(1, "4MB pages: %d cycles per access\n", touchcycles(huge, HUGEPGSIZE, 20));
+  printf(1, "Page Table Size: %d pages (was %d before the 4MB region)\n",
+         getptsize(), pts);
+  munmap(small, HUGEPGSIZE);
+  munmap(huge, HUGEPGSIZE);
+}
 
 int
 main(int argc, char *argv[])
@@ -77,6 +154,10 @@ main(int argc, char *argv[])
   printf(1, "Physical Pages: %d\n", pp4);
   printf(1, "Page Table Size: %d pages\n", pts4);
   
+  printf(1, "Page faults: %d, free pages: %d\n", pgfaults(), getNumFreePages());
+
+  hugetest();
+
   printf(1, "\n=== Test Complete ===\n");
   
   exit();
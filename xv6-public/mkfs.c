@@ -22,7 +22,8 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGSIZE+1;  // header + data blocks; set with -l
+int nhash;    // Blocks of a hashed root directory, or 0; set with -d
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +41,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint fbmap(struct dinode *din, uint fbn);
+void dirappend(uint inum, struct dirent *de);
 
 // convert to intel byte order
 ushort
@@ -76,8 +79,23 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  while(argc > 2 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-l") == 0)
+      nlog = atoi(argv[2]);
+    else if(strcmp(argv[1], "-d") == 0)
+      nhash = atoi(argv[2]);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc < 2 || argv[1][0] == '-'){
+    fprintf(stderr, "Usage: mkfs [-l nlog] [-d nblocks] fs.img files...\n");
+    exit(1);
+  }
+  if(nlog < MAXOPBLOCKS+1 || nlog > LOGSIZE+1){
+    fprintf(stderr, "mkfs: nlog must be between %d and %d\n",
+            MAXOPBLOCKS+1, LOGSIZE+1);
     exit(1);
   }
 
@@ -101,13 +119,15 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(NSWAP);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, NSWAP);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < FSSIZE + NSWAP; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -116,16 +136,25 @@ main(int argc, char *argv[])
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
+  if(nhash > 0){
+    // A hashed root directory: all its blocks, zeroed, up front.
+    rinode(rootino, &din);
+    din.major = xshort(DIRHASHED);
+    winode(rootino, &din);
+    memset(buf, 0, sizeof(buf));
+    for(i = 0; i < nhash; i++)
+      iappend(rootino, buf, BSIZE);
+  }
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   for(i = 2; i < argc; i++){
     assert(index(argv[i], '/') == 0);
@@ -147,7 +176,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -158,7 +187,8 @@ main(int argc, char *argv[])
   // fix size of root inode dir
   rinode(rootino, &din);
   off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
+  if(nhash == 0)
+    off = ((off/BSIZE) + 1) * BSIZE;
   din.size = xint(off);
   winode(rootino, &din);
 
@@ -252,6 +282,86 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the sector of block fbn of din, allocating it and the
+// indirect blocks above it if necessary.
+uint
+fbmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint x, n, i;
+  int level;
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(freeblock++);
+    }
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+  for(level = 1, n = NINDIRECT; fbn >= n; level++, n *= NINDIRECT)
+    fbn -= n;
+  assert(level <= NLEVEL);
+  if(xint(din->addrs[NDIRECT+level-1]) == 0){
+    din->addrs[NDIRECT+level-1] = xint(freeblock++);
+  }
+  x = xint(din->addrs[NDIRECT+level-1]);
+  for(; level > 0; level--){
+    n /= NINDIRECT;
+    i = fbn / n % NINDIRECT;
+    rsect(x, (char*)indirect);
+    if(indirect[i] == 0){
+      indirect[i] = xint(freeblock++);
+      wsect(x, (char*)indirect);
+    }
+    x = xint(indirect[i]);
+  }
+  return x;
+}
+
+// Same as dirhash() in fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Add de to directory inum: at the end, or in a hashed directory
+// in the first free entry from block dirhash(name) on.
+void
+dirappend(uint inum, struct dirent *de)
+{
+  struct dinode din;
+  struct dirent des[BSIZE / sizeof(struct dirent)];
+  uint nb, b, i, j, x;
+
+  rinode(inum, &din);
+  if(xshort(din.major) != DIRHASHED){
+    iappend(inum, de, sizeof(*de));
+    return;
+  }
+  nb = xint(din.size) / BSIZE;
+  b = dirhash(de->name) % nb;
+  for(i = 0; i < nb; i++, b = (b + 1) % nb){
+    x = fbmap(&din, b);
+    rsect(x, (char*)des);
+    for(j = 0; j < BSIZE / sizeof(struct dirent); j++){
+      if(des[j].inum == 0){
+        des[j] = *de;
+        wsect(x, (char*)des);
+        return;
+      }
+    }
+  }
+  fprintf(stderr, "mkfs: hashed root directory is full\n");
+  exit(1);
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,7 +369,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -268,22 +377,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fbmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -0,0 +1,8 @@
+// mmap() protection and flag bits
+#define PROT_READ      0x1   // Pages may be read (always implied)
+#define PROT_WRITE     0x2   // Pages may be written
+
+#define MAP_SHARED     0x01  // Writes go back to the file, shared across fork
+#define MAP_PRIVATE    0x02  // Writes stay private (copy-on-write)
+#define MAP_ANONYMOUS  0x20  // Zero-filled memory, no file (fd is ignored)
+#define MAP_HUGE       0x40  // Anonymous, backed by 4MB pages (len a multiple of 4MB)
@@ -0,0 +1,481 @@
+// Memory-mapped regions (mmap/munmap).
+//
+// Each process has a small table of VMAs (struct vma in proc.h)
+// describing its mmap'd regions.  Nothing is mapped when a region
+// is created; the page fault handler calls mmapfault() to fill in
+// one page at a time, either zeroed (MAP_ANONYMOUS) or read from
+// the backing file with readi().  Dirty pages of MAP_SHARED file
+// mappings are written back when the region is unmapped, which
+// also happens on exit and exec.
+//
+// Regions live below p->sz like the rest of user memory: a new
+// region either fills a hole left by munmap or extends p->sz.
+// MAP_HUGE regions are 4MB aligned and are mapped one 4MB page
+// (a PTE_PS page directory entry) per fault.
+//
+// exec() maps a program's segments as private regions of the
+// executable's inode too, so a program only reads the pages it
+// touches.  A read fault on a private file region maps a page from
+// a small cache of file pages, read-only, so every process running
+// the same binary shares its text; a write copies it as for fork.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "mman.h"
+
+struct pcpage {
+  uint dev;                    // 0 if the slot is unused
+  uint inum;
+  uint off;                    // File offset of the page
+  uint n;                      // Bytes read from the file, rest zero
+  uint pa;                     // Physical page; the cache holds a ref
+};
+
+struct {
+  struct spinlock lock;
+  int hand;                    // Next slot to reuse when full
+  struct pcpage page[NPCACHE];
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Return a page holding n bytes of ip from off, zero after that,
+// with a new reference for the caller.  The caller has ip locked,
+// which keeps anyone else from filling or invalidating the same
+// pages meanwhile.  Returns the physical address, or 0.
+static uint
+pcacheget(struct inode *ip, uint off, uint n)
+{
+  struct pcpage *pp;
+  char *mem;
+  uint pa;
+
+  acquire(&pcache.lock);
+  for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++){
+    if(pp->dev == ip->dev && pp->inum == ip->inum &&
+       pp->off == off && pp->n == n){
+      incref(pp->pa);
+      release(&pcache.lock);
+      return pp->pa;
+    }
+  }
+  release(&pcache.lock);
+
+  if((mem = swapkalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(n > 0 && readi(ip, mem, off, n) != n){
+    kfree(mem);
+    return 0;
+  }
+  pa = V2P(mem);
+  incref(pa);
+
+  acquire(&pcache.lock);
+  for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++)
+    if(pp->dev == 0)
+      break;
+  if(pp == &pcache.page[NPCACHE]){
+    // Evicting only stops sharing; mappings keep their own refs.
+    pp = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    kfree(P2V(pp->pa));
+  }
+  pp->dev = ip->dev;
+  pp->inum = ip->inum;
+  pp->off = off;
+  pp->n = n;
+  pp->pa = pa;
+  release(&pcache.lock);
+  ip->pcached = 1;
+  return pa;
+}
+
+// Forget the cached pages of ip, whose contents are changing.
+// Pages already mapped keep the old contents.  Caller has ip locked.
+// Only looks through the cache if ip->pcached says it may have
+// pages there, so writes to files nobody maps cost nothing.
+void
+pcacheinval(struct inode *ip)
+{
+  struct pcpage *pp;
+
+  if(!ip->pcached)
+    return;
+  ip->pcached = 0;
+  acquire(&pcache.lock);
+  for(pp = pcache.page; pp < &pcache.page[NPCACHE]; pp++){
+    if(pp->dev == ip->dev && pp->inum == ip->inum){
+      kfree(P2V(pp->pa));
+      pp->dev = 0;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Take another reference to v's backing file or inode.
+static void
+vmadup(struct vma *v)
+{
+  if(v->f)
+    filedup(v->f);
+  else if(v->ip)
+    idup(v->ip);
+}
+
+// Drop v's reference to its backing file or inode.
+static void
+vmaput(struct vma *v)
+{
+  if(v->f)
+    fileclose(v->f);
+  else if(v->ip){
+    begin_op();
+    iput(v->ip);
+    end_op();
+  }
+}
+
+// Return the region of p containing va, or 0.
+struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end != 0 && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Is [start, end) free: no region and no mapped page in it?
+int
+rangefree(struct proc *p, uint start, uint end)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end != 0 && start < v->end && v->start < end)
+      return 0;
+  for(a = start; a < end; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & (PTE_P|PTE_SWAP)))
+      return 0;
+  }
+  return 1;
+}
+
+// Create a region of len bytes backed by f at offset off
+// (or anonymous if f is 0).  addr is a hint: it is used if it
+// names a free, page-aligned range below p->sz; otherwise the
+// region is placed at the end of the address space.
+// Takes a new reference to f.  Returns the start address, or 0.
+uint
+mmapregion(struct proc *p, uint addr, uint len, int prot, int flags,
+           struct file *f, uint off)
+{
+  struct vma *v, *nv;
+  uint align;
+
+  nv = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0){
+      nv = v;
+      break;
+    }
+  }
+  if(nv == 0)
+    return 0;
+
+  align = (flags & MAP_HUGE) ? HUGEPGSIZE : PGSIZE;
+  if(addr == 0 || addr % align != 0 || addr + len < addr ||
+     addr + len > p->sz || !rangefree(p, addr, addr + len)){
+    addr = (p->sz + align - 1) & ~(align - 1);
+    if(addr + len < addr || addr + len >= KERNBASE)
+      return 0;
+    p->sz = addr + len;
+  }
+
+  nv->start = addr;
+  nv->end = addr + len;
+  nv->prot = prot | PROT_READ;
+  nv->flags = flags;
+  nv->f = f ? filedup(f) : 0;
+  nv->ip = f ? f->ip : 0;
+  nv->off = off;
+  nv->fend = nv->end;
+  return addr;
+}
+
+// Write the dirty pages of v in [start, end) back to its file.
+// Only MAP_SHARED file mappings are written back, and never
+// past the current end of the file.
+static void
+mmapwriteback(struct proc *p, struct vma *v, uint start, uint end)
+{
+  // Same per-transaction limit as filewrite().
+  int max = ((MAXOPBLOCKS-1-5-2) / 2) * 512;
+  struct inode *ip;
+  pte_t *pte;
+  uint a, off;
+  int i, n, n1;
+  char *mem;
+
+  if(v->f == 0 || !(v->flags & MAP_SHARED) || !(v->prot & PROT_WRITE))
+    return;
+  ip = v->ip;
+  for(a = start; a < end; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_D))
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    off = v->off + (a - v->start);
+    for(i = 0; i < PGSIZE; i += n1){
+      n1 = PGSIZE - i;
+      if(n1 > max)
+        n1 = max;
+      begin_op();
+      ilock(ip);
+      n = 0;
+      if(off + i < ip->size){
+        n = ip->size - (off + i);
+        if(n > n1)
+          n = n1;
+        writei(ip, mem + i, off + i, n);
+      }
+      iunlock(ip);
+      end_op();
+      if(n < n1)
+        break;
+    }
+  }
+}
+
+// Unmap [start, end) (page aligned) from every region of p that
+// overlaps it, writing back MAP_SHARED file pages first.  Regions
+// are trimmed or split as needed; addresses outside any region are
+// left alone.  Returns 0 on success, -1 on failure.
+int
+munmapregion(struct proc *p, uint start, uint end)
+{
+  struct vma *v, *nv;
+  uint s, e;
+
+  // A split needs a free slot, and 4MB pages can only go whole;
+  // check before changing anything.
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end != 0 && (v->flags & MAP_HUGE) && start < v->end &&
+       v->start < end && (start % HUGEPGSIZE || end % HUGEPGSIZE))
+      return -1;
+    if(v->end != 0 && v->start < start && end < v->end){
+      for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+        if(nv->end == 0)
+          break;
+      if(nv == &p->vma[NVMA])
+        return -1;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0 || end <= v->start || v->end <= start)
+      continue;
+    s = start > v->start ? start : v->start;
+    e = end < v->end ? end : v->end;
+    mmapwriteback(p, v, s, e);
+    if(unmapuvm(p->pgdir, s, e) < 0)
+      return -1;
+
+    if(s == v->start && e == v->end){
+      vmaput(v);
+      memset(v, 0, sizeof(*v));
+    } else if(s == v->start){
+      v->off += e - v->start;
+      v->start = e;
+    } else if(e == v->end){
+      v->end = s;
+    } else {
+      for(nv = p->vma; nv->end != 0; nv++)
+        ;
+      *nv = *v;
+      nv->start = e;
+      nv->off += e - v->start;
+      v->end = s;
+      vmadup(nv);
+    }
+  }
+  return 0;
+}
+
+// Fill in the page at va of region v: the shared zero page for a
+// read of private anonymous memory, a fresh zeroed page for other
+// anonymous accesses, a read-only cached page for a read of a
+// private file region, or else a new copy of the file contents.
+// The file is read from v's inode, which the caller has locked.
+// Returns 0 on success, -1 on error.
+static int
+fillpage(struct proc *p, struct vma *v, uint va, int write)
+{
+  char *mem;
+  uint off, n, pa;
+  int perm;
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->flags & MAP_SHARED)
+    perm |= PTE_MAPSH;
+
+  if(v->ip == 0){
+    if(!write && !(v->flags & MAP_SHARED))
+      return mapzeropage(p->pgdir, va);
+    return allocuvm_ondemand(p->pgdir, va, perm);
+  }
+
+  off = v->off + (va - v->start);
+  n = va < v->fend ? v->fend - va : 0;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if(!write && !(v->flags & MAP_SHARED)){
+    // Past end of file readi() stops short; don't cache that.
+    if(off + n > v->ip->size)
+      n = off < v->ip->size ? v->ip->size - off : 0;
+    if((pa = pcacheget(v->ip, off, n)) == 0)
+      return -1;
+    if(mappages(p->pgdir, (char*)va, PGSIZE, pa, PTE_U) < 0){
+      kfree(P2V(pa));
+      return -1;
+    }
+    return 0;
+  }
+
+  if((mem = swapkalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  // Past end of file the page just stays zero.
+  readi(v->ip, mem, off, n);
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Handle a fault at va in region v.  Besides the faulting page,
+// up to p->faultaround following pages of the region are mapped
+// the same way, so sequential touchers take one fault per window.
+// Returns 0 on success, -1 on error.
+int
+mmapfault(struct proc *p, struct vma *v, uint va, int write)
+{
+  pte_t *pte;
+  uint a;
+  int i, r, locked;
+
+  if(v->flags & MAP_HUGE)
+    return maphugepage(p->pgdir, va & ~(HUGEPGSIZE-1));
+
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & (PTE_P|PTE_SWAP)))
+    return -1;
+
+  if(v->ip){
+    // Reading the file may sleep, which is not allowed if the
+    // kernel took this fault while holding a spinlock.
+    pushcli();
+    locked = mycpu()->ncli > 1;
+    popcli();
+    if(locked)
+      return -1;
+    ilock(v->ip);
+  }
+
+  r = fillpage(p, v, va, write);
+  a = va + PGSIZE;
+  for(i = 0; r == 0 && i < p->faultaround && a < v->end; i++, a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & (PTE_P|PTE_SWAP)))
+      continue;
+    if(fillpage(p, v, a, write) < 0)
+      break;
+  }
+
+  if(v->ip)
+    iunlock(v->ip);
+  return r;
+}
+
+// Make sure the user memory [va, va+len) of p is backed, faulting
+// in mmap'd pages now rather than in the middle of a system call.
+// If write is set the memory must also be writable by p.
+// Returns 0 on success, -1 if the range is not valid memory.
+int
+mmapprefault(struct proc *p, uint va, uint len, int write)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    // 4MB pages are always user read-write
+    if(p->pgdir[PDX(a)] & PTE_PS)
+      continue;
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P)){
+      // Not the guard page below the stack.
+      if(!(*pte & PTE_U))
+        return -1;
+      if(write && (v = findvma(p, a)) != 0 && !(v->prot & PROT_WRITE))
+        return -1;
+      continue;
+    }
+    if(swapin(p->pgdir, a) == 0)
+      continue;
+    if((v = findvma(p, a)) == 0 || mmapfault(p, v, a, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Give child np copies of p's regions.
+void
+mmapfork(struct proc *np, struct proc *p)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    vmadup(&np->vma[i]);
+  }
+}
+
+// Drop every region of p on exit or exec.  Dirty shared pages
+// are written back; the pages themselves go away with p's page
+// table.
+void
+mmapexit(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0)
+      continue;
+    mmapwriteback(p, v, v->start, v->end);
+    vmaput(v);
+    memset(v, 0, sizeof(*v));
+  }
+}
@@ -2,47 +2,53 @@
 #include "stat.h"
 #include "user.h"
 #include "fcntl.h"
+#include "mman.h"
 
-int main(void)
+#define ANON (MAP_PRIVATE|MAP_ANONYMOUS)
+#define RW   (PROT_READ|PROT_WRITE)
+
+// Anonymous mappings: lazily allocated, bad sizes rejected.
+void
+anontest(void)
 {
-  uint ret;
+  char *ret;
   printf(1, "Start: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
 
-  ret = mmap (-1234);
+  ret = mmap(0, -1234, RW, ANON, -1, 0);
   if(ret == 0)
     printf(1, "mmap failed for wrong inputs\n");
   else
     exit();
   
-  ret = mmap (1234);
+  ret = mmap(0, 1234, RW, ANON, -1, 0);
   if(ret == 0)
     printf(1, "mmap failed for wrong inputs\n");
   else
     exit();
 
   
-  ret = mmap(4096);
+  ret = mmap(0, 4096, RW, ANON, -1, 0);
   
   if(ret == 0 )
     printf(1, "mmap failed\n");
   else {
     printf(1, "After mmap one page: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
 
-    char *addr = (char *) ret;
+    char *addr = ret;
 
     addr[0] = 'a';
     
     printf(1, "After access of one page: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
   }
 
-  ret = mmap(8192);
+  ret = mmap(0, 8192, RW, ANON, -1, 0);
 
   if(ret == 0 )
     printf(1, "mmap failed\n");
   else {
     printf(1, "After mmap two pages: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
 
-    char *addr = (char *) ret;
+    char *addr = ret;
 
     addr[0] = 'a';
     
@@ -50,8 +56,129 @@ int main(void)
     addr[8000] = 'a';
 
     printf(1, "After access of second page: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
+
+    if(munmap(addr, 8192) < 0)
+      printf(1, "munmap failed\n");
+    else
+      printf(1, "After munmap two pages: memory usage in pages: virtual: %d, physical %d\n", numvp(), numpp());
+  }
+}
+
+// File mappings: read through a MAP_PRIVATE mapping, then modify
+// the file through a MAP_SHARED one and read it back with read().
+void
+filetest(void)
+{
+  char buf[64], *p;
+  int fd, i;
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "filetest: open failed\n");
+    return;
+  }
+  for(i = 0; i < 2*4096/sizeof(buf); i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    write(fd, buf, sizeof(buf));
+  }
+
+  p = mmap(0, 8192, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == 0){
+    printf(1, "filetest: private mmap failed\n");
+    return;
+  }
+  if(p[0] != 'a' || p[4096] != 'a' + (4096/sizeof(buf)) % 26)
+    printf(1, "filetest: private mapping has wrong data\n");
+  else
+    printf(1, "filetest: private mapping ok\n");
+  munmap(p, 8192);
+
+  p = mmap(0, 4096, RW, MAP_SHARED, fd, 4096);
+  if(p == 0){
+    printf(1, "filetest: shared mmap failed\n");
+    return;
+  }
+  p[0] = 'X';
+  p[1] = 'Y';
+  munmap(p, 4096);
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  for(i = 0; i < 4096/sizeof(buf); i++)   // skip to offset 4096
+    read(fd, buf, sizeof(buf));
+  read(fd, buf, 2);
+  close(fd);
+  unlink("mmapfile");
+  if(buf[0] == 'X' && buf[1] == 'Y')
+    printf(1, "filetest: shared write-back ok\n");
+  else
+    printf(1, "filetest: shared write-back FAILED\n");
+}
+
+// Read faults on anonymous memory share the zero page, so reading
+// a large mapping costs no memory; fault-around maps several pages
+// per fault.
+#define ZPAGES 64
+
+int
+touch(char *p, int write)
+{
+  int i, sum;
+
+  sum = 0;
+  for(i = 0; i < ZPAGES; i++){
+    if(write)
+      p[i*4096] = i;
+    else
+      sum += p[i*4096];
+  }
+  return sum;
+}
+
+void
+zerotest(void)
+{
+  char *p;
+  int n, f, free, old, sum;
+
+  p = mmap(0, ZPAGES*4096, RW, ANON, -1, 0);
+  if(p == 0){
+    printf(1, "zerotest: mmap failed\n");
+    return;
+  }
+  free = getNumFreePages();
+  f = pgfaults();
+  sum = touch(p, 0);
+  printf(1, "zerotest: read %d pages: %d faults, %d pages allocated\n",
+         ZPAGES, pgfaults() - f, free - getNumFreePages());
+  if(sum != 0)
+    printf(1, "zerotest: zero page not zero FAILED\n");
+  f = pgfaults();
+  touch(p, 1);
+  printf(1, "zerotest: wrote %d pages: %d faults, %d pages allocated\n",
+         ZPAGES, pgfaults() - f, free - getNumFreePages());
+  munmap(p, ZPAGES*4096);
+
+  for(n = 0; n <= 8; n += 4){
+    old = faultaround(n);
+    p = mmap(0, ZPAGES*4096, RW, ANON, -1, 0);
+    if(p == 0){
+      printf(1, "zerotest: mmap failed\n");
+      return;
+    }
+    f = pgfaults();
+    touch(p, 1);
+    printf(1, "zerotest: faultaround %d: %d write faults for %d pages\n",
+           n, pgfaults() - f, ZPAGES);
+    munmap(p, ZPAGES*4096);
+    faultaround(old);
   }
+}
 
+int main(void)
+{
+  anontest();
+  filetest();
+  zerotest();
   exit();
- 
 }
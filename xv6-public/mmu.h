@@ -90,24 +90,40 @@ struct segdesc {
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+// A page directory entry with PTE_PS maps a 4MB page directly.
+#define HUGEPGSIZE      (NPTENTRIES*PGSIZE)   // bytes mapped by such a PDE
+#define HUGEPGROUNDUP(sz)  (((sz)+HUGEPGSIZE-1) & ~(HUGEPGSIZE-1))
+
 // Page table/directory entry flags.
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
 #define PTE_M           0x100   // Memory-mapped (for optional extension)
-// Shared page flag - when set on a PTE it marks this page as a shared
-// page between parent and child (not copied on fork, and not freed
-// by deallocuvm; freed explicitly by unmapshared()).
+// Page of a shared-memory segment (shm.c): stays writable and
+// shared with fork children instead of becoming copy-on-write.
 #define PTE_S           0x200
+// Page of a MAP_SHARED mmap region: stays writable and shared
+// (refcounted) with fork children instead of becoming copy-on-write.
+#define PTE_MAPSH       0x400
+// Not present, paged out to swap (swap.c): the address bits hold
+// the slot number, and PTE_W and PTE_U are kept for swapping in.
+#define PTE_SWAP        0x800
+#define SWAPSLOT(pte)   ((uint)(pte) >> PTXSHIFT)
+#define SWAPPTE(slot)   ((uint)(slot) << PTXSHIFT | PTE_SWAP)
+
+// Page fault error code bits (tf->err for T_PGFLT)
+#define FEC_PR          0x1     // Protection violation (page was present)
+#define FEC_WR          0x2     // Fault was caused by a write
+#define FEC_U           0x4     // Fault happened in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
 #ifndef __ASSEMBLER__
-typedef uint pte_t;
-
 // Task state segment format
 struct taskstate {
   uint link;         // Old ts selector
@@ -0,0 +1,97 @@
+// Path lookup benchmark: fill a directory with nfiles files and
+// open each of them by a path several directories deep, round
+// after round, then check that removed and re-created names are
+// seen at once.  Prints lookups per second.  "make ROOTHASH=n"
+// builds a hashed root directory to compare.
+//
+// usage: namebench [nfiles [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define DIR "nb/d1/d2/d3/d4"
+
+void
+path(char *p, int i)
+{
+  strcpy(p, DIR "/f000");
+  p[sizeof(DIR)+1] += i / 100;
+  p[sizeof(DIR)+2] += i / 10 % 10;
+  p[sizeof(DIR)+3] += i % 10;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char p[32];
+  int nfiles, rounds, i, r, fd, t0, t1;
+
+  nfiles = argc > 1 ? atoi(argv[1]) : 200;
+  rounds = argc > 2 ? atoi(argv[2]) : 10;
+  if(nfiles < 1 || nfiles > 999 || rounds < 1){
+    printf(1, "usage: namebench [nfiles(1-999) [rounds]]\n");
+    exit();
+  }
+
+  if(mkdir("nb") < 0 || mkdir("nb/d1") < 0 || mkdir("nb/d1/d2") < 0 ||
+     mkdir("nb/d1/d2/d3") < 0 || mkdir(DIR) < 0){
+    printf(1, "namebench: mkdir failed\n");
+    exit();
+  }
+  for(i = 0; i < nfiles; i++){
+    path(p, i);
+    if((fd = open(p, O_CREATE | O_RDWR)) < 0){
+      printf(1, "namebench: create %s failed\n", p);
+      exit();
+    }
+    close(fd);
+  }
+
+  t0 = uptime();
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < nfiles; i++){
+      path(p, i);
+      if((fd = open(p, O_RDONLY)) < 0){
+        printf(1, "namebench: open %s failed\n", p);
+        exit();
+      }
+      close(fd);
+    }
+  }
+  t1 = uptime();
+  printf(1, "namebench: %d lookups of %d-element paths, %d ticks",
+         rounds * nfiles, 6, t1 - t0);
+  if(t1 > t0)
+    printf(1, ", %d lookups/sec", rounds * nfiles * 100 / (t1 - t0));
+  printf(1, "\n");
+
+  // Removed names must be gone and re-created ones back.
+  path(p, 0);
+  if(unlink(p) < 0 || open(p, O_RDONLY) >= 0){
+    printf(1, "namebench: %s still there after unlink\n", p);
+    exit();
+  }
+  if((fd = open(p, O_CREATE | O_RDWR)) < 0 || close(fd) < 0 ||
+     (fd = open(p, O_RDONLY)) < 0){
+    printf(1, "namebench: %s missing after create\n", p);
+    exit();
+  }
+  close(fd);
+
+  for(i = 0; i < nfiles; i++){
+    path(p, i);
+    unlink(p);
+  }
+  unlink(DIR);
+  unlink("nb/d1/d2/d3");
+  unlink("nb/d1/d2");
+  unlink("nb/d1");
+  if(unlink("nb") < 0){
+    printf(1, "namebench: cannot remove nb\n");
+    exit();
+  }
+  printf(1, "namebench ok\n");
+  exit();
+}
@@ -1,14 +1,44 @@
-#define NPROC        64  // maximum number of processes
+#ifndef NPROC
+#define NPROC        64  // maximum number of processes (make NPROC=n to change)
+#endif
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         3  // scheduler priority levels, 0 is highest
+#define BOOSTTICKS  100  // ticks between scheduler priority boosts
 #define NOFILE       16  // open files per process
+#define NVMA         16  // mmap regions per process
+#define NSHM         32  // shared-memory segments per system
+#define NSHMATT       8  // shared-memory attachments per process
+#define SHMMAXPAGES (PGSIZE/4)  // largest segment, in pages
+#define FAULTAROUND   0  // default extra pages mapped per mmap fault
+#define MAXFAULTAROUND 16  // upper limit for faultaround()
+#define NPCACHE     256  // file pages shared by private mappings
+#define NHUGEPAGE     8  // most 4MB frames kept back for MAP_HUGE regions
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define MAXPATH     128  // maximum file path name
+#define MAXOPBLOCKS  16  // max # of blocks any FS op writes
+#define LOGSIZE      127  // max data blocks in on-disk log (one header block)
+#ifndef NBUF
+#define NBUF         1024  // size of disk block cache (make NBUF=n to change)
+#endif
+#define NBUCKET      1031  // most buffer cache hash buckets
+#ifndef FSSIZE
+#define FSSIZE       4000  // size of file system in blocks (make FSSIZE=n to change)
+#endif
+#define NSWAP        8192  // swap blocks mkfs puts after the file system
+#define SWAPHIGH      256  // kswapd pages out until this many pages are free
+#define NREADAHEAD   8  // blocks read ahead of sequential readi()
+#define NMAPCACHE   16  // block addresses each inode keeps from its last indirect block
+#define NDCACHE     256  // entries in the directory name cache
+#define NPROFSAMPLE 2048  // samples each CPU's profiler ring holds
+#define NLOCKSTAT    64  // lock names lockstat() keeps statistics for
+#define NVMEVENT      7  // VM events counted, see vmstat.h
+#ifndef PIPEPAGES
+#define PIPEPAGES     4  // pages in a pipe's buffer (make PIPEPAGES=n to change)
+#endif
+#define SHAREPT         1  // fork shares page table pages until first write
 
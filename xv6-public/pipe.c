@@ -1,6 +1,7 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
 #include "fs.h"
@@ -8,21 +9,46 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of PIPEPAGES pages, and data moves in
+// and out of it with memmove, a page at a time at most.  A write of
+// a whole page-aligned page into an empty ring page lends the
+// writer's page to the pipe instead (pageloan()): the pipe holds a
+// reference and the writer's mapping turns copy-on-write.  A
+// page-aligned read of a whole lent page maps it into the reader
+// the same way (pagerecv()), so neither side copies it.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEPAGES];  // the ring
+  char *loan[PIPEPAGES];  // a writer's page in place of page[i], or 0
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rwait;      // readers sleeping on nread
+  int wwait;      // writers sleeping on nwrite
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++){
+    if(p->page[i])
+      kfree(p->page[i]);
+    if(p->loan[i])
+      kfree(p->loan[i]);
+  }
+  kfree((char*)p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -30,6 +56,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->page[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +78,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -56,6 +86,16 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+// Wake one of the nwaiting processes sleeping on chan, if any.
+// It wakes the next one if there is still something left for it.
+// Caller holds p->lock.
+static void
+pipewakeup(int nwaiting, void *chan)
+{
+  if(nwaiting > 0)
+    wakeone(chan);
+}
+
 void
 pipeclose(struct pipe *p, int writable)
 {
@@ -69,7 +109,7 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
@@ -78,21 +118,45 @@ pipeclose(struct pipe *p, int writable)
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m, s, off;
+  uint pa;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; i += m){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      pipewakeup(p->rwait, &p->nread);
+      p->wwait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->wwait--;
+    }
+    s = p->nwrite / PGSIZE % PIPEPAGES;
+    off = p->nwrite % PGSIZE;
+    if(off == 0 && (uint)(addr + i) % PGSIZE == 0 && n - i >= PGSIZE &&
+       p->nwrite + PGSIZE <= p->nread + PIPESIZE &&
+       (pa = pageloan(myproc()->pgdir, (uint)(addr + i))) != 0){
+      p->loan[s] = P2V(pa);
+      m = PGSIZE;
+    } else {
+      m = PGSIZE - off;
+      if(m > p->nread + PIPESIZE - p->nwrite)
+        m = p->nread + PIPESIZE - p->nwrite;
+      if(m > n - i)
+        m = n - i;
+      // A fault on addr fails the write.
+      if(copyuser(p->page[s] + off, addr + i, m) < 0){
+        n = -1;
+        break;
+      }
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  pipewakeup(p->rwait, &p->nread);  //DOC: pipewrite-wakeup1
+  if(p->nwrite != p->nread + PIPESIZE)
+    pipewakeup(p->wwait, &p->nwrite);
   release(&p->lock);
   return n;
 }
@@ -100,7 +164,7 @@ pipewrite(struct pipe *p, char *addr, int n)
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m, s, off;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -108,14 +172,40 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    p->rwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->rwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    s = p->nread / PGSIZE % PIPEPAGES;
+    off = p->nread % PGSIZE;
+    if(p->loan[s] && off == 0 && (uint)(addr + i) % PGSIZE == 0 &&
+       n - i >= PGSIZE &&
+       pagerecv(myproc()->pgdir, (uint)(addr + i), V2P(p->loan[s])) == 0){
+      p->loan[s] = 0;
+      m = PGSIZE;
+    } else {
+      m = PGSIZE - off;
+      if(m > p->nwrite - p->nread)
+        m = p->nwrite - p->nread;
+      if(m > n - i)
+        m = n - i;
+      if(copyuser(addr + i, (p->loan[s] ? p->loan[s] : p->page[s]) + off,
+                  m) < 0){
+        i = -1;
+        break;
+      }
+      // A lent page goes back once it has been read.
+      if(p->loan[s] && off + m == PGSIZE){
+        kfree(p->loan[s]);
+        p->loan[s] = 0;
+      }
+    }
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  pipewakeup(p->wwait, &p->nwrite);  //DOC: piperead-wakeup
+  if(p->nread != p->nwrite)
+    pipewakeup(p->rwait, &p->nread);
   release(&p->lock);
   return i;
 }
@@ -0,0 +1,86 @@
+// Pipe throughput benchmark: a child writes kb kilobytes into a
+// pipe in bs-byte writes and the parent reads them back, checking
+// the data as it goes.  With page-aligned buffers and bs a multiple
+// of the page size, whole pages move through the pipe without
+// being copied; a nonzero offset misaligns the buffers to compare
+// with plain copying.  Try "make PIPEPAGES=n" for other pipe sizes.
+//
+// usage: pipebench [kb [bs [offset]]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+// A buffer of n bytes starting offset bytes into a fresh page.
+char*
+pagebuf(int n, int offset)
+{
+  char *p;
+
+  p = sbrk(n + 2*PGSIZE);
+  p += (PGSIZE - (uint)p % PGSIZE) % PGSIZE;
+  return p + offset;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb, bs, offset, fds[2], i, n, t0, t1;
+  uint total, pos;
+  char *buf;
+
+  kb = argc > 1 ? atoi(argv[1]) : 4096;
+  bs = argc > 2 ? atoi(argv[2]) : PGSIZE;
+  offset = argc > 3 ? atoi(argv[3]) : 0;
+  if(kb < 1 || bs < 4 || bs % 4 != 0 || bs > 64*PGSIZE ||
+     offset < 0 || offset >= PGSIZE){
+    printf(1, "usage: pipebench [kb [bs(multiple of 4) [offset]]]\n");
+    exit();
+  }
+  total = kb * 1024;
+  buf = pagebuf(bs, offset);
+
+  if(pipe(fds) < 0){
+    printf(1, "pipebench: pipe failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(pos = 0; pos < total; pos += n){
+      n = total - pos < bs ? total - pos : bs;
+      for(i = 0; i < n / 4; i++)
+        ((uint*)buf)[i] = pos / 4 + i;
+      if(write(fds[1], buf, n) != n){
+        printf(1, "pipebench: write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  for(pos = 0; (n = read(fds[0], buf, bs)) > 0; pos += n){
+    // Byte k of the stream is byte k%4 of the int k/4.
+    for(i = (1024 - pos % 1024) % 1024; i < n; i += 1024)
+      if((uchar)buf[i] != ((pos + i) >> 2 & 0xff)){
+        printf(1, "pipebench: wrong data at byte %d\n", pos + i);
+        exit();
+      }
+  }
+  wait();
+  t1 = uptime();
+  close(fds[0]);
+
+  if(pos != total){
+    printf(1, "pipebench: read %d bytes of %d\n", pos, total);
+    exit();
+  }
+  printf(1, "pipebench: %d KB in %d-byte writes at offset %d, %d ticks",
+         kb, bs, offset, t1 - t0);
+  if(t1 > t0)
+    printf(1, ", %d KB/sec", kb * 100 / (t1 - t0));
+  printf(1, "\n");
+  exit();
+}
@@ -6,10 +6,19 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "schedstat.h"
+
+// Sleeping processes wait on lists hashed by channel, so that
+// wakeup() looks only at processes that may be sleeping on its
+// channel rather than at all NPROC slots.  Each list is in the
+// order the processes went to sleep.
+#define NWAITQ 64
+#define WAITQ(chan) (((uint)(chan) >> 4 ^ (uint)(chan) >> 12) % NWAITQ)
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *waitq[NWAITQ];  // Sleeping processes, by channel
 } ptable;
 
 static struct proc *initproc;
@@ -17,13 +26,161 @@ static struct proc *initproc;
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
+static void kprocret(void);
+
+static void wakeup1(void *chan, int all);
+
+// Multilevel feedback queue scheduling with per-CPU run queues.
+// A process starts at its base level and drops a level each
+// time it uses up the quantum of its level, so CPU-bound work
+// sinks below interactive work.  Every BOOSTTICKS ticks all
+// processes go back to their base level.  An idle CPU steals
+// from the CPU with the longest queue.
+//
+// Each queue has its own lock, so CPUs dispatch, steal and
+// yield without taking ptable.lock.  A queue holds exactly the
+// RUNNABLE processes on it, and its lock covers their moves to
+// and from RUNNING and changes to their p->cpu.  A process
+// switches out and in holding the lock of the queue of the CPU
+// it is on, which plays the part ptable.lock plays in xv6: no
+// one can make it RUNNABLE again until it is off its stack.
+// Lock order: ptable.lock before a run queue lock, and never
+// two run queue locks at once.  n may be read without the
+// lock, which lets idle CPUs poll without taking it.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  volatile int n;              // Processes queued
+  uint boostepoch;             // Boost period queue was last reset in
+  uint nswitch;                // Processes dispatched
+  uint nsteal;                 // Processes stolen from other CPUs
+} runq[NCPU];
+
+#define QUANTUM(prio)  (1 << (prio))  // ticks
+#define BOOSTEPOCH()   (ticks / BOOSTTICKS)
+
+// Mark p RUNNABLE and append it to its level of its CPU's run
+// queue.  Caller holds that queue's lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+
+  if(p->boostepoch != BOOSTEPOCH()){
+    p->boostepoch = BOOSTEPOCH();
+    p->prio = p->baseprio;
+    p->qticks = 0;
+  }
+  p->state = RUNNABLE;
+  p->rqnext = 0;
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+  rq->n++;
+  p->rqtime = rdtsc();
+}
+
+// Remove and return the first process of the highest non-empty
+// level of rq, or 0.  Caller holds rq->lock.
+static struct proc*
+runqget(struct runq *rq)
+{
+  struct proc *p;
+  int l;
+
+  for(l = 0; l < NPRIO; l++){
+    if((p = rq->head[l]) != 0){
+      if((rq->head[l] = p->rqnext) == 0)
+        rq->tail[l] = 0;
+      rq->n--;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// If a boost period has begun, requeue everything on rq, which
+// sends each process back to its base level.
+// Caller holds rq->lock.
+static void
+runqboost(struct runq *rq)
+{
+  struct proc *p, *list, **tailp;
+  uint64 t;
+
+  if(rq->boostepoch == BOOSTEPOCH())
+    return;
+  rq->boostepoch = BOOSTEPOCH();
+  list = 0;
+  tailp = &list;
+  while((p = runqget(rq)) != 0){
+    *tailp = p;
+    tailp = &p->rqnext;
+  }
+  *tailp = 0;
+  while((p = list) != 0){
+    list = p->rqnext;
+    t = p->rqtime;
+    setrunnable(p);
+    p->rqtime = t;
+  }
+}
+
+// Return the run queue other than rq with the most processes,
+// or 0 if all are empty.  Reads n without the queue locks, so
+// the answer is only a hint.
+static struct runq*
+runqvictim(struct runq *rq)
+{
+  struct runq *q, *best;
+
+  best = 0;
+  for(q = runq; q < &runq[ncpu]; q++)
+    if(q != rq && q->n > 0 && (best == 0 || q->n > best->n))
+      best = q;
+  return best;
+}
+
+// Make p, which is on no run queue, RUNNABLE on its CPU's run
+// queue.  A SLEEPING p's CPU may still be switching away from
+// it; taking the queue lock waits for that to finish.
+static void
+makerunnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
 
-static void wakeup1(void *chan);
+  acquire(&rq->lock);
+  setrunnable(p);
+  release(&rq->lock);
+}
+
+// Lock and return the run queue p is on, or would go back to.
+// p->cpu only changes under the lock of its old queue.
+static struct runq*
+lockrunq(struct proc *p)
+{
+  struct runq *rq;
+
+  for(;;){
+    rq = &runq[p->cpu];
+    acquire(&rq->lock);
+    if(rq == &runq[p->cpu])
+      return rq;
+    release(&rq->lock);
+  }
+}
 
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
 }
 
 // Must be called with interrupts disabled
@@ -89,9 +246,19 @@ found:
   p->state = EMBRYO;
   p->pid = nextpid++;
   
-  // Initialize mmap fields
-  p->mmap_start = 0;
-  p->mmap_end = 0;
+  // No mmap regions yet
+  memset(p->vma, 0, sizeof(p->vma));
+  memset(p->shm, 0, sizeof(p->shm));
+  p->faultaround = FAULTAROUND;
+  memset(p->vmcount, 0, sizeof(p->vmcount));
+  memset(p->vmchild, 0, sizeof(p->vmchild));
+  p->prio = p->baseprio = 0;
+  p->qticks = 0;
+  p->boostepoch = BOOSTEPOCH();
+  p->cpu = cpuid();
+  p->waitcycles = 0;
+  p->nrun = 0;
+  p->uidle = 0;
 
   release(&ptable.lock);
 
@@ -150,11 +317,24 @@ userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  makerunnable(p);
+}
 
-  p->state = RUNNABLE;
+// Start a kernel process that runs fn, which must never return.
+// It has no user memory, just the kernel mappings.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
 
-  release(&ptable.lock);
+  if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kproc");
+  // Return from kprocret into fn instead of trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  p->context->eip = (uint)kprocret;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  makerunnable(p);
 }
 
 // Grow current process's memory by n bytes.
@@ -170,11 +350,15 @@ growproc(int n)
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
+    if(munmapregion(curproc, PGROUNDUP(sz + n), sz) < 0)
+      return -1;
+    if(shmshrink(curproc, PGROUNDUP(sz + n)) < 0)
+      return -1;
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
+    flushtlb(curproc->pgdir);
   }
   curproc->sz = sz;
-  switchuvm(curproc);
   return 0;
 }
 
@@ -202,9 +386,10 @@ fork(void)
   }
   np->sz = curproc->sz;
   
-  // Copy mmap information to child
-  np->mmap_start = curproc->mmap_start;
-  np->mmap_end = curproc->mmap_end;
+  // Copy mmap regions to child
+  mmapfork(np, curproc);
+  shmfork(np, curproc);
+  np->faultaround = curproc->faultaround;
   
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -221,11 +406,8 @@ fork(void)
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
-
-  np->state = RUNNABLE;
-
-  release(&ptable.lock);
+  np->prio = np->baseprio = curproc->baseprio;
+  makerunnable(np);
 
   return pid;
 }
@@ -243,6 +425,10 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  // Write back and drop mmap'd regions.
+  mmapexit(curproc);
+  shmexit(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -259,19 +445,22 @@ exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup1(curproc->parent, 1);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup1(initproc, 1);
     }
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return.  wait() won't
+  // free our stack until the switch lets go of the queue lock.
   curproc->state = ZOMBIE;
+  acquire(&runq[curproc->cpu].lock);
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -282,7 +471,7 @@ int
 wait(void)
 {
   struct proc *p;
-  int havekids, pid;
+  int havekids, pid, e;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
@@ -294,11 +483,16 @@ wait(void)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
-        // Found one.
+        // Found one.  Its CPU may still be switching away
+        // from it; that holds the run queue lock until done.
+        acquire(&runq[p->cpu].lock);
+        release(&runq[p->cpu].lock);
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
+        for(e = 0; e < NVMEVENT; e++)
+          curproc->vmchild[e] += p->vmcount[e] + p->vmchild[e];
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -316,7 +510,9 @@ wait(void)
     }
 
     // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    curproc->uidle = 1;
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+    curproc->uidle = 0;
   }
 }
 
@@ -333,20 +529,39 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq = &runq[c - cpus], *victim;
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
+    // Don't take a lock unless there is something to run.
+    if(rq->n == 0 && runqvictim(rq) == 0)
+      continue;
+
+    // Take the most urgent process of our own run queue,
+    // or steal one if we have none.  The stolen process is
+    // RUNNABLE on no queue until we have our lock back.
+    acquire(&rq->lock);
+    runqboost(rq);
+    if((p = runqget(rq)) == 0 && (victim = runqvictim(rq)) != 0){
+      release(&rq->lock);
+      acquire(&victim->lock);
+      if((p = runqget(victim)) != 0)
+        p->cpu = rq - runq;
+      release(&victim->lock);
+      acquire(&rq->lock);
+      if(p)
+        rq->nsteal++;
+    }
+    if(p){
+      p->waitcycles += rdtsc() - p->rqtime;
+      p->nrun++;
+      rq->nswitch++;
 
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release rq->lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
       switchuvm(p);
@@ -359,13 +574,36 @@ scheduler(void)
       // It should have changed its p->state before coming back.
       c->proc = 0;
     }
-    release(&ptable.lock);
+    release(&rq->lock);
 
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Charge the running process for a timer tick.  Returns 1 if it
+// should yield: it has used up the quantum of its level, which
+// also moves it down a level, or a process of a higher level is
+// waiting on this CPU.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq = &runq[p->cpu];
+  int l;
+
+  if(++p->qticks >= QUANTUM(p->prio)){
+    p->qticks = 0;
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    return 1;
+  }
+  for(l = 0; l < p->prio; l++)
+    if(rq->head[l])
+      return 1;
+  return 0;
+}
+
+// Enter scheduler.  Must hold only the lock of this CPU's
+// run queue and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -377,8 +615,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&runq[p->cpu].lock))
+    panic("sched runq lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -394,10 +632,13 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&runq[p->cpu].lock);  //DOC: yieldlock
+  setrunnable(p);
   sched();
-  release(&ptable.lock);
+  // Maybe on another CPU now, stolen.
+  release(&runq[p->cpu].lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -406,8 +647,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding the run queue lock from scheduler.
+  release(&runq[myproc()->cpu].lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -421,12 +662,22 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+// A kernel process's very first scheduling by scheduler()
+// will swtch here, and "return" to its function (see kproc).
+static void
+kprocret(void)
+{
+  // Still holding the run queue lock from scheduler.
+  release(&runq[myproc()->cpu].lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct proc **pp;
   
   if(p == 0)
     panic("sleep");
@@ -435,7 +686,7 @@ sleep(void *chan, struct spinlock *lk)
     panic("sleep without lk");
 
   // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
+  // change p->state, and the run queue lock to call sched.
   // Once we hold ptable.lock, we can be
   // guaranteed that we won't miss any wakeup
   // (wakeup runs with ptable.lock locked),
@@ -444,33 +695,62 @@ sleep(void *chan, struct spinlock *lk)
     acquire(&ptable.lock);  //DOC: sleeplock1
     release(lk);
   }
-  // Go to sleep.
+  // Go to sleep, at the end of chan's wait list.
   p->chan = chan;
   p->state = SLEEPING;
-
+  p->wqnext = 0;
+  for(pp = &ptable.waitq[WAITQ(chan)]; *pp; pp = &(*pp)->wqnext)
+    ;
+  *pp = p;
+
+  // A wakeup from here on waits for the run queue lock,
+  // which the switch holds until we are off this stack.
+  acquire(&runq[p->cpu].lock);
+  release(&ptable.lock);
   sched();
+  release(&runq[p->cpu].lock);
 
   // Tidy up.
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);  //DOC: sleeplock2
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
+// Wake up the processes sleeping on chan: all of them, or only
+// the one that has slept longest.
 // The ptable lock must be held.
 static void
-wakeup1(void *chan)
+wakeup1(void *chan, int all)
 {
-  struct proc *p;
+  struct proc **pp, *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(pp = &ptable.waitq[WAITQ(chan)]; (p = *pp) != 0; ){
+    if(p->chan != chan){
+      pp = &p->wqnext;
+      continue;
+    }
+    *pp = p->wqnext;
+    makerunnable(p);
+    if(!all)
+      break;
+  }
+}
+
+// Take sleeping p off its wait list.
+// The ptable lock must be held.
+static void
+waitqremove(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.waitq[WAITQ(p->chan)]; *pp; pp = &(*pp)->wqnext)
+    if(*pp == p){
+      *pp = p->wqnext;
+      return;
+    }
+  panic("waitqremove");
 }
 
 // Wake up all processes sleeping on chan.
@@ -478,7 +758,18 @@ void
 wakeup(void *chan)
 {
   acquire(&ptable.lock);
-  wakeup1(chan);
+  wakeup1(chan, 1);
+  release(&ptable.lock);
+}
+
+// Wake up only the process that has slept longest on chan, for
+// waiters of which only one can make progress.  Each woken
+// process must pass the wakeup on if others could go too.
+void
+wakeone(void *chan)
+{
+  acquire(&ptable.lock);
+  wakeup1(chan, 0);
   release(&ptable.lock);
 }
 
@@ -495,8 +786,10 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      if(p->state == SLEEPING){
+        waitqremove(p);
+        makerunnable(p);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -505,6 +798,65 @@ kill(int pid)
   return -1;
 }
 
+// Set the base scheduling level of process pid to prio.
+// Returns the old level, or -1 on error.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+  struct runq *rq;
+  int old;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      // setrunnable() reads p->prio under the queue lock.
+      rq = lockrunq(p);
+      old = p->baseprio;
+      p->baseprio = prio;
+      // A queued process moves when it is next queued.
+      p->prio = prio;
+      p->qticks = 0;
+      release(&rq->lock);
+      release(&ptable.lock);
+      return old;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Fill in *st with system-wide scheduler counters and those of
+// the calling process.
+void
+schedstat(struct schedstat *st)
+{
+  struct proc *p = myproc();
+  uint64 cycles;
+  uint n;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  for(i = 0; i < ncpu; i++){
+    acquire(&runq[i].lock);
+    st->nswitch += runq[i].nswitch;
+    st->nsteal += runq[i].nsteal;
+    release(&runq[i].lock);
+  }
+  st->prio = p->prio;
+  st->nrun = p->nrun;
+  cycles = p->waitcycles;
+  st->waitcycles = avg64(cycles, st->nrun);
+
+  acquire(&tickslock);
+  cycles = tickcycles;
+  n = ticks;
+  release(&tickslock);
+  st->tickcycles = avg64(cycles, n);
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -541,3 +893,84 @@ procdump(void)
     cprintf("\n");
   }
 }
+
+#define SWAPSCAN 64  // pages swapvictim() looks at per hold of ptable.lock
+
+// May swapvictim() take pages from p?  Caller holds ptable.lock
+// and the lock of p's run queue, without which p could be
+// dispatched and touch its pages meanwhile.
+static int
+swappable(struct proc *p)
+{
+  if(p->state == UNUSED || p->state == EMBRYO || p->state == ZOMBIE)
+    return 0;
+  return p->uidle && (p->state != RUNNING || p == myproc());
+}
+
+// Pick a user page for swap.c to page out, and replace its PTE
+// with the swap entry e, keeping PTE_W and PTE_U.  A clock hand
+// sweeps over the pages of processes that are not using their user
+// memory (p->uidle) and not running elsewhere, clearing PTE_A as it
+// goes; the first page found without PTE_A is the victim.  Only
+// pages mapped once, from a private page table, qualify.  The
+// sweep lets go of its locks every SWAPSCAN pages.
+// Returns the page's physical address, or 0 if there is none.
+uint
+swapvictim(uint e)
+{
+  static int hand;
+  static uint handva;
+  struct proc *p;
+  struct runq *rq;
+  pde_t *pde;
+  pte_t *pte;
+  uint pa;
+  int n, scan;
+
+  acquire(&ptable.lock);
+  scan = 0;
+  // Twice around: the first time may only clear PTE_A bits.
+  for(n = 0; n <= 2*NPROC; n++, hand = (hand + 1) % NPROC, handva = 0){
+    p = &ptable.proc[hand];
+    if(p->state == UNUSED || !p->uidle)
+      continue;
+    rq = lockrunq(p);
+    for(; swappable(p) && handva < p->sz && handva < KERNBASE;
+        handva += PGSIZE){
+      if(++scan % SWAPSCAN == 0){
+        release(&rq->lock);
+        release(&ptable.lock);
+        acquire(&ptable.lock);
+        rq = lockrunq(p);
+        if(!swappable(p))
+          break;
+      }
+      pde = &p->pgdir[PDX(handva)];
+      if(!(*pde & PTE_P) || !(*pde & PTE_W) || (*pde & PTE_PS)){
+        handva = PGADDR(PDX(handva) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      pte = (pte_t*)P2V(PTE_ADDR(*pde)) + PTX(handva);
+      if(!(*pte & PTE_P) || !(*pte & PTE_U) || (*pte & (PTE_S|PTE_MAPSH)))
+        continue;
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        continue;
+      }
+      pa = PTE_ADDR(*pte);
+      if(getrefcount(pa) != 1)
+        continue;
+      *pte = e | (*pte & (PTE_W|PTE_U));
+      handva += PGSIZE;
+      // Others reload %cr3 when they are next scheduled.
+      if(p == myproc())
+        flushtlb(p->pgdir);
+      release(&rq->lock);
+      release(&ptable.lock);
+      return pa;
+    }
+    release(&rq->lock);
+  }
+  release(&ptable.lock);
+  return 0;
+}
@@ -32,6 +32,25 @@ struct context {
   uint eip;
 };
 
+// A memory-mapped region created by mmap() or exec().  Pages are
+// faulted in lazily, from the inode if ip != 0.
+struct vma {
+  uint start;                  // First address (page aligned)
+  uint end;                    // One past the last address, 0 if unused
+  int prot;                    // PROT_* bits
+  int flags;                   // MAP_* bits
+  struct file *f;              // File passed to mmap(), or 0
+  struct inode *ip;            // Backing inode, or 0 if anonymous
+  uint off;                    // File offset that start maps
+  uint fend;                   // Zero-fill from here on, e.g. bss
+};
+
+// A shared-memory segment attached by shmat().
+struct shmatt {
+  struct shmseg *seg;          // Segment, or 0 if unused
+  uint va;                     // Where it is mapped
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -49,8 +68,22 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  uint mmap_start;             // Start of memory-mapped region
-  uint mmap_end;               // End of memory-mapped region
+  struct vma vma[NVMA];        // Memory-mapped regions
+  struct shmatt shm[NSHMATT];  // Attached shared-memory segments
+  int faultaround;             // Extra pages mapped per mmap fault
+  uint vmcount[NVMEVENT];      // VM events, see vmstat.h
+  uint vmchild[NVMEVENT];      // Same, for children reaped by wait()
+  int prio;                    // Scheduler level, 0 is highest
+  int baseprio;                // Level set by setpriority()
+  int qticks;                  // Ticks used at this level
+  uint boostepoch;             // Boost period prio was last reset in
+  int cpu;                     // Run queue it is on, or CPU it last ran on
+  struct proc *rqnext;         // Next on its run queue
+  uint64 rqtime;               // TSC when it last became RUNNABLE
+  uint64 waitcycles;           // TSC cycles spent RUNNABLE, in total
+  uint nrun;                   // Times it was dispatched
+  int uidle;                   // Kernel won't touch user memory; may swap
+  struct proc *wqnext;         // Next on its wait list, while SLEEPING
 };
 
 // Process memory is laid out contiguously, low addresses first:
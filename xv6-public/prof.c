@@ -0,0 +1,153 @@
+// Sampling profiler.
+//
+// While profiling is on, every CPU's LAPIC timer interrupts
+// PROFMULT times per clock tick, and each interrupt records where
+// the CPU was in that CPU's ring of samples.  Only every
+// PROFMULT-th interrupt goes on to be a clock tick, so ticks,
+// sleep() and scheduling quanta keep their length.  A user
+// program drains the rings with prof(PROF_READ, ...); samples
+// that find a ring full are dropped and counted.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "prof.h"
+
+#define PROFMULT 10     // Profiling interrupts per clock tick
+
+struct profring {
+  struct spinlock lock;
+  struct profsample s[NPROFSAMPLE];
+  uint head;            // Next sample to read
+  uint tail;            // Next sample to write
+  int mult;             // Interrupts per tick the timer is set to
+  uint n;               // Profiling interrupts taken
+  uint ndrop;           // Samples dropped because the ring was full
+};
+
+static struct profring profring[NCPU];
+static volatile int profon;
+
+void
+profinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    initlock(&profring[i].lock, "prof");
+    profring[i].mult = 1;
+  }
+}
+
+// Called by trap() for every timer interrupt, with interrupts off.
+// Returns 1 if the interrupt was only for profiling and is not a
+// clock tick.
+int
+profintr(struct trapframe *tf)
+{
+  struct profring *r;
+  struct profsample *s;
+  struct proc *p;
+  int mult;
+
+  r = &profring[cpuid()];
+  mult = profon ? PROFMULT : 1;
+  if(r->mult != mult){
+    r->mult = mult;
+    r->n = 0;
+    lapictimer(mult);
+  }
+  if(!profon)
+    return 0;
+
+  acquire(&r->lock);
+  if(r->tail - r->head == NPROFSAMPLE)
+    r->ndrop++;
+  else {
+    p = myproc();
+    s = &r->s[r->tail++ % NPROFSAMPLE];
+    s->eip = tf->eip;
+    s->pid = p ? p->pid : 0;
+    s->cpu = cpuid();
+    s->user = (tf->cs&3) == DPL_USER;
+  }
+  release(&r->lock);
+  return ++r->n % PROFMULT != 0;
+}
+
+// Copy up to n samples, from all CPUs, to dst in user memory.
+// Returns the number copied, or -1 if out of memory or if
+// profiling is off and there are no samples left.
+static int
+profread(char *dst, int n)
+{
+  struct profring *r;
+  char *buf;
+  int i, m, k;
+
+  // Copy through a kernel page, so that no lock is held while
+  // faulting on dst.
+  if((buf = kalloc()) == 0)
+    return -1;
+  k = 0;
+  for(r = profring; r < &profring[ncpu] && k < n; ){
+    acquire(&r->lock);
+    m = r->tail - r->head;
+    if(m > n - k)
+      m = n - k;
+    if(m > PGSIZE / sizeof(struct profsample))
+      m = PGSIZE / sizeof(struct profsample);
+    for(i = 0; i < m; i++)
+      ((struct profsample*)buf)[i] = r->s[r->head++ % NPROFSAMPLE];
+    release(&r->lock);
+    if(m == 0){
+      r++;
+      continue;
+    }
+    if(copyuser(dst + k * sizeof(struct profsample), buf,
+                m * sizeof(struct profsample)) < 0){
+      kfree(buf);
+      return -1;
+    }
+    k += m;
+  }
+  kfree(buf);
+  if(k == 0 && !profon)
+    return -1;
+  return k;
+}
+
+// The profiler's system call: cmd is one of the PROF_ commands in
+// prof.h, and PROF_READ copies up to n samples to dst.
+int
+prof(int cmd, char *dst, int n)
+{
+  struct profring *r;
+  uint ndrop;
+
+  switch(cmd){
+  case PROF_START:
+    for(r = profring; r < &profring[ncpu]; r++){
+      acquire(&r->lock);
+      r->head = r->tail = 0;
+      r->ndrop = 0;
+      release(&r->lock);
+    }
+    profon = 1;
+    return 0;
+  case PROF_STOP:
+    profon = 0;
+    ndrop = 0;
+    for(r = profring; r < &profring[ncpu]; r++)
+      ndrop += r->ndrop;
+    return ndrop;
+  case PROF_READ:
+    return profread(dst, n);
+  }
+  return -1;
+}
@@ -0,0 +1,14 @@
+// Sampling profiler: one sample per profiling timer interrupt,
+// returned by prof(PROF_READ, ...).
+struct profsample {
+  uint eip;         // Where the CPU was interrupted
+  ushort pid;       // Process running, 0 if none
+  uchar cpu;
+  uchar user;       // 1 if eip is a user address
+};
+
+// prof() commands
+#define PROF_START  1   // Discard old samples and start sampling
+#define PROF_STOP   2   // Stop; returns the number of samples dropped
+#define PROF_READ   3   // Take up to n samples; returns how many,
+                        // or -1 when stopped and all are taken
@@ -0,0 +1,79 @@
+// Profile a command: sample where every CPU is while it runs and
+// save the samples in prof.out.  After shutting down, symbolize
+// them on the host with
+//
+//   ./profsym.pl fs.img kernel.sym [command.sym]
+//
+// usage: profile command [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "prof.h"
+
+#define NBUF 512
+
+struct profsample buf[NBUF];
+
+// Move the samples taken so far to fd.  Returns 0, or -1 once
+// profiling has stopped and every sample has been moved.
+int
+drain(int fd)
+{
+  int n;
+
+  while((n = prof(PROF_READ, buf, NBUF)) > 0){
+    if(write(fd, buf, n * sizeof(buf[0])) != n * sizeof(buf[0])){
+      printf(2, "profile: write prof.out failed\n");
+      exit();
+    }
+  }
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  int fd, pid, ndrop, t0, t1;
+
+  if(argc < 2){
+    printf(2, "usage: profile command [args...]\n");
+    exit();
+  }
+  unlink("prof.out");
+  if((fd = open("prof.out", O_CREATE | O_WRONLY)) < 0){
+    printf(2, "profile: cannot create prof.out\n");
+    exit();
+  }
+
+  prof(PROF_START, 0, 0);
+  t0 = uptime();
+  if((pid = fork()) == 0){
+    close(fd);
+    exec(argv[1], argv + 1);
+    printf(2, "profile: exec %s failed\n", argv[1]);
+    exit();
+  }
+  // The rings fill in a few seconds; empty them as the command runs.
+  if(fork() == 0){
+    while(drain(fd) == 0)
+      sleep(10);
+    exit();
+  }
+  while(wait() != pid)
+    ;
+  t1 = uptime();
+  ndrop = prof(PROF_STOP, 0, 0);
+  wait();
+  close(fd);
+
+  if(stat("prof.out", &st) < 0){
+    printf(2, "profile: cannot stat prof.out\n");
+    exit();
+  }
+  printf(1, "profile: %d samples in %d ticks, %d dropped, in prof.out\n",
+         st.size / sizeof(buf[0]), t1 - t0, ndrop);
+  exit();
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/perl -w
+
+# Print a flat profile from the samples the profile program left
+# in prof.out on an xv6 file system image.  Kernel samples are
+# symbolized against kernel.sym, and user samples against the
+# given program's .sym file, or else counted by pid.
+#
+# usage: profsym.pl fs.img kernel.sym [prog.sym]
+
+use strict;
+
+my $BSIZE = 512;
+my $NDIRECT = 10;
+my $NINDIRECT = $BSIZE / 4;
+my $NLEVEL = 3;
+
+@ARGV >= 2 or die "usage: profsym.pl fs.img kernel.sym [prog.sym]\n";
+my ($img, $ksym, $usym) = @ARGV;
+
+open(my $fh, "<", $img) or die "profsym.pl: $img: $!\n";
+binmode($fh);
+
+sub block {
+    my ($b) = @_;
+    my $data;
+    seek($fh, $b * $BSIZE, 0) or die "profsym.pl: seek: $!\n";
+    read($fh, $data, $BSIZE) == $BSIZE or die "profsym.pl: short read\n";
+    return $data;
+}
+
+my @sb = unpack("V9", block(1));
+my $inodestart = $sb[5];
+
+# Return (size, addrs) of inode inum.
+sub inode {
+    my ($inum) = @_;
+    my $ipb = $BSIZE / 64;
+    my $d = substr(block($inodestart + int($inum / $ipb)), ($inum % $ipb) * 64, 64);
+    my ($type, $major, $minor, $nlink, $size, @addrs) = unpack("v4 V V13", $d);
+    return ($size, @addrs);
+}
+
+# Append the data blocks under block b, level levels of indirect
+# blocks up, to @$list.
+sub walk {
+    my ($list, $b, $level) = @_;
+    return if $b == 0;
+    if($level == 0){
+        push(@$list, $b);
+        return;
+    }
+    walk($list, $_, $level - 1) foreach unpack("V$NINDIRECT", block($b));
+}
+
+sub readfile {
+    my ($inum) = @_;
+    my ($size, @addrs) = inode($inum);
+    my @list;
+    walk(\@list, $addrs[$_], 0) foreach 0 .. $NDIRECT - 1;
+    walk(\@list, $addrs[$NDIRECT + $_], $_ + 1) foreach 0 .. $NLEVEL - 1;
+    return substr(join("", map { block($_) } @list), 0, $size);
+}
+
+# Find prof.out in the root directory.
+my $dir = readfile(1);
+my $inum = 0;
+for(my $off = 0; $off + 16 <= length($dir); $off += 16){
+    my ($i, $name) = unpack("v Z14", substr($dir, $off, 16));
+    if($i != 0 && $name eq "prof.out"){
+        $inum = $i;
+        last;
+    }
+}
+$inum or die "profsym.pl: no prof.out in $img\n";
+
+sub loadsyms {
+    my ($file) = @_;
+    my @syms;
+    open(my $s, "<", $file) or die "profsym.pl: $file: $!\n";
+    while(<$s>){
+        push(@syms, [hex($1), $2]) if /^([0-9a-f]+) (\S+)/;
+    }
+    close($s);
+    return [sort { $a->[0] <=> $b->[0] } @syms];
+}
+
+# The name of the last symbol at or below addr.
+sub symbolize {
+    my ($syms, $addr) = @_;
+    my ($lo, $hi) = (0, scalar(@$syms) - 1);
+    return sprintf("0x%x", $addr) if $hi < 0 || $addr < $syms->[0][0];
+    while($lo < $hi){
+        my $mid = int(($lo + $hi + 1) / 2);
+        if($syms->[$mid][0] <= $addr){ $lo = $mid; } else { $hi = $mid - 1; }
+    }
+    return $syms->[$lo][1];
+}
+
+my $ksyms = loadsyms($ksym);
+my $usyms = defined($usym) ? loadsyms($usym) : undef;
+
+my $data = readfile($inum);
+my (%count, $n, $nuser);
+$n = $nuser = 0;
+for(my $off = 0; $off + 8 <= length($data); $off += 8){
+    my ($eip, $pid, $cpu, $user) = unpack("V v C C", substr($data, $off, 8));
+    my $name;
+    if($user){
+        $nuser++;
+        $name = $usyms ? "user:" . symbolize($usyms, $eip) : "user:pid $pid";
+    } else {
+        $name = $pid == 0 ? "(idle) " . symbolize($ksyms, $eip) : symbolize($ksyms, $eip);
+    }
+    $count{$name}++;
+    $n++;
+}
+$n or die "profsym.pl: prof.out holds no samples\n";
+
+printf("%d samples, %d kernel, %d user\n", $n, $n - $nuser, $nuser);
+printf("%8s %6s  %s\n", "samples", "%", "function");
+foreach my $name (sort { $count{$b} <=> $count{$a} || $a cmp $b } keys %count){
+    printf("%8d %6.2f  %s\n", $count{$name}, 100 * $count{$name} / $n, $name);
+}
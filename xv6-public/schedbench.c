@@ -0,0 +1,88 @@
+// Scheduler benchmark: CPU-bound spinners compete with
+// interactive processes that sleep for a tick and then do a
+// little work.  Each interactive process reports how long it
+// waited, on average, between waking up and running; the parent
+// reports the context-switch rate over the run.
+//
+// usage: schedbench [nspin [ninteractive [ticks [spinprio]]]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "schedstat.h"
+
+volatile int sink;
+
+void
+spinner(int end)
+{
+  int i;
+
+  while(uptime() < end)
+    for(i = 0; i < 100000; i++)
+      sink += i;
+}
+
+void
+interactive(int id, int end)
+{
+  struct schedstat st;
+  int i, n;
+
+  n = 0;
+  while(uptime() < end){
+    sleep(1);
+    for(i = 0; i < 1000; i++)
+      sink += i;
+    n++;
+  }
+  schedstat(&st);
+  printf(1, "interactive %d: %d wakeups, %d dispatches, level %d, %d cycles wait\n",
+         id, n, st.nrun, st.prio, st.waitcycles);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedstat s0, s1;
+  int nspin, nint, ticks, spinprio, end, i, pid, t0, t1;
+
+  nspin = argc > 1 ? atoi(argv[1]) : 4;
+  nint = argc > 2 ? atoi(argv[2]) : 2;
+  ticks = argc > 3 ? atoi(argv[3]) : 300;
+  spinprio = argc > 4 ? atoi(argv[4]) : -1;
+
+  printf(1, "schedbench: %d spinners, %d interactive, %d ticks\n",
+         nspin, nint, ticks);
+  schedstat(&s0);
+  t0 = uptime();
+  end = t0 + ticks;
+  for(i = 0; i < nspin; i++){
+    if((pid = fork()) == 0){
+      spinner(end);
+      exit();
+    }
+    // Optionally start spinners at a low level rather than
+    // waiting for them to sink.
+    if(pid > 0 && spinprio >= 0)
+      setpriority(pid, spinprio);
+  }
+  for(i = 0; i < nint; i++){
+    if(fork() == 0){
+      interactive(i, end);
+      exit();
+    }
+  }
+  for(i = 0; i < nspin + nint; i++)
+    wait();
+  t1 = uptime();
+  schedstat(&s1);
+
+  printf(1, "%d context switches in %d ticks (%d/sec), %d steals\n",
+         s1.nswitch - s0.nswitch, t1 - t0,
+         t1 > t0 ? (s1.nswitch - s0.nswitch) * 100 / (t1 - t0) : 0,
+         s1.nsteal - s0.nsteal);
+  printf(1, "%d cycles per timer interrupt in wakeup (make NPROC=n to compare)\n",
+         s1.tickcycles);
+  exit();
+}
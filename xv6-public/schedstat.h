@@ -0,0 +1,9 @@
+// Scheduler statistics, returned by schedstat().
+struct schedstat {
+  uint nswitch;     // Context switches into processes, all CPUs
+  uint nsteal;      // Processes taken from another CPU's run queue
+  int prio;         // Caller's current scheduling level
+  uint nrun;        // Times the caller was dispatched
+  uint waitcycles;  // Caller's average TSC cycles from RUNNABLE to running
+  uint tickcycles;  // Average TSC cycles a timer interrupt spends waking sleepers
+};
@@ -0,0 +1,284 @@
+// Named shared-memory segments.
+//
+// A segment is a run of zeroed physical pages found by a key.
+// shmget() creates or opens one; shmat() maps all of its pages into
+// the caller at once with PTE_S, so fork shares them instead of
+// making them copy-on-write, and shmdt() unmaps it again.  Every
+// mapping holds its own reference to each page, and the segment
+// counts attachments: the last shmdt, exit or exec frees it.
+// shmrm() frees a segment nothing is attached to, and makes an
+// attached one unreachable by key, so it goes with its last user.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+struct shmseg {
+  int key;                     // 0 if unused or removed
+  int id;                      // What shmget() returned, 0 if unused
+  int npages;
+  int ref;                     // Number of attachments
+  uint *pa;                    // Physical address of each page
+};
+
+struct {
+  struct spinlock lock;
+  int seq;                     // Makes ids of reused slots differ
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Free the pages of a segment taken out of the table.  Mappings
+// of the pages hold references of their own.
+static void
+shmfree(struct shmseg *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(P2V(s->pa[i]));
+  if(s->pa)
+    kfree((char*)s->pa);
+}
+
+// Empty the slot of s, moving the segment to *old for shmfree()
+// once shmtable.lock is released.  Caller holds shmtable.lock.
+static void
+shmunlink(struct shmseg *s, struct shmseg *old)
+{
+  *old = *s;
+  memset(s, 0, sizeof(*s));
+}
+
+// Drop one attachment of s.
+static void
+shmput(struct shmseg *s)
+{
+  struct shmseg old;
+
+  memset(&old, 0, sizeof(old));
+  acquire(&shmtable.lock);
+  if(--s->ref == 0)
+    shmunlink(s, &old);
+  release(&shmtable.lock);
+  shmfree(&old);
+}
+
+// Return the id of the segment with the given key, -1 if it has
+// fewer than npages pages, or 0 if there is none.
+// Caller holds shmtable.lock.
+static int
+shmlookup(int key, int npages)
+{
+  struct shmseg *s;
+
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++)
+    if(s->key == key)
+      return npages <= s->npages ? s->id : -1;
+  return 0;
+}
+
+// Return the id of the segment with the given key, creating it
+// with npages zeroed pages if there is none.  Opening an existing
+// segment requires npages to be no larger than it.
+// Returns -1 on error.
+int
+shmget(int key, int npages)
+{
+  struct shmseg *s, new;
+  char *mem;
+  int id;
+
+  if(key <= 0 || npages <= 0 || npages > SHMMAXPAGES)
+    return -1;
+
+  acquire(&shmtable.lock);
+  id = shmlookup(key, npages);
+  release(&shmtable.lock);
+  if(id != 0)
+    return id;
+
+  // Allocate and zero the pages without the lock, which would
+  // keep interrupts off for the whole of it.
+  memset(&new, 0, sizeof(new));
+  if((new.pa = (uint*)kalloc()) == 0)
+    return -1;
+  for(new.npages = 0; new.npages < npages; new.npages++){
+    if((mem = kalloc()) == 0){
+      shmfree(&new);
+      return -1;
+    }
+    memset(mem, 0, PGSIZE);
+    new.pa[new.npages] = V2P(mem);
+  }
+
+  // Publish it, unless someone else made the segment meanwhile.
+  acquire(&shmtable.lock);
+  if((id = shmlookup(key, npages)) == 0){
+    id = -1;
+    for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+      if(s->id == 0){
+        *s = new;
+        s->key = key;
+        s->id = id = ++shmtable.seq * NSHM + (s - shmtable.seg);
+        memset(&new, 0, sizeof(new));
+        break;
+      }
+    }
+  }
+  release(&shmtable.lock);
+  shmfree(&new);
+  return id;
+}
+
+// Remove segment id.  Its key no longer finds it, and it is freed
+// now if nothing is attached, or else on its last detach.
+// Returns 0 on success, -1 if there is no such segment.
+int
+shmrm(int id)
+{
+  struct shmseg *s, old;
+
+  if(id <= 0)
+    return -1;
+  memset(&old, 0, sizeof(old));
+  acquire(&shmtable.lock);
+  s = &shmtable.seg[id % NSHM];
+  if(s->key == 0 || s->id != id){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->key = 0;
+  if(s->ref == 0)
+    shmunlink(s, &old);
+  release(&shmtable.lock);
+  shmfree(&old);
+  return 0;
+}
+
+// Map segment id into p at va, or at the end of the address space
+// if va is 0.  A chosen range must be page aligned and unused.
+// The caller must flush the TLB.  Returns the address, or 0.
+uint
+shmattach(struct proc *p, int id, uint va)
+{
+  struct shmatt *a;
+  struct shmseg *s;
+  uint len;
+  int i;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++)
+    if(a->seg == 0)
+      break;
+  if(a == &p->shm[NSHMATT] || id <= 0)
+    return 0;
+
+  acquire(&shmtable.lock);
+  s = &shmtable.seg[id % NSHM];
+  if(s->key == 0 || s->id != id)
+    goto bad;
+  len = s->npages * PGSIZE;
+  if(va == 0)
+    va = PGROUNDUP(p->sz);
+  if(va % PGSIZE != 0 || va + len < va || va + len > KERNBASE ||
+     !rangefree(p, va, va + len))
+    goto bad;
+  for(i = 0; i < s->npages; i++){
+    if(mappages(p->pgdir, (char*)va + i*PGSIZE, PGSIZE, s->pa[i],
+                PTE_W|PTE_U|PTE_S) < 0){
+      unmapuvm(p->pgdir, va, va + i*PGSIZE);
+      goto bad;
+    }
+    incref(s->pa[i]);
+  }
+  s->ref++;
+  release(&shmtable.lock);
+
+  a->seg = s;
+  a->va = va;
+  if(va + len > p->sz)
+    p->sz = va + len;
+  return va;
+
+bad:
+  release(&shmtable.lock);
+  return 0;
+}
+
+// Unmap the segment attached at va from p.  The caller must flush
+// the TLB.  Returns 0 on success, -1 if nothing is attached there.
+int
+shmdetach(struct proc *p, uint va)
+{
+  struct shmatt *a;
+  uint end;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++)
+    if(a->seg && a->va == va)
+      break;
+  if(a == &p->shm[NSHMATT])
+    return -1;
+  end = va + a->seg->npages * PGSIZE;
+  if(unmapuvm(p->pgdir, va, end) < 0)
+    return -1;
+  if(end == p->sz)
+    p->sz = va;
+  shmput(a->seg);
+  a->seg = 0;
+  a->va = 0;
+  return 0;
+}
+
+// Detach every segment that reaches above sz, for a shrinking
+// process.  Returns 0 on success, -1 on failure.
+int
+shmshrink(struct proc *p, uint sz)
+{
+  struct shmatt *a;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++)
+    if(a->seg && a->va + a->seg->npages * PGSIZE > sz)
+      if(shmdetach(p, a->va) < 0)
+        return -1;
+  return 0;
+}
+
+// Give child np the attachments of parent p.  copyuvm() has
+// already shared the pages themselves.
+void
+shmfork(struct proc *np, struct proc *p)
+{
+  int i;
+
+  acquire(&shmtable.lock);
+  for(i = 0; i < NSHMATT; i++){
+    np->shm[i] = p->shm[i];
+    if(np->shm[i].seg)
+      np->shm[i].seg->ref++;
+  }
+  release(&shmtable.lock);
+}
+
+// Drop all of p's attachments, on exit or exec.  The mappings go
+// away with the page table.
+void
+shmexit(struct proc *p)
+{
+  struct shmatt *a;
+
+  for(a = p->shm; a < &p->shm[NSHMATT]; a++){
+    if(a->seg)
+      shmput(a->seg);
+    a->seg = 0;
+    a->va = 0;
+  }
+}
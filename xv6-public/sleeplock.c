@@ -37,7 +37,8 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
-  wakeup(lk);
+  // Only one waiter can take the lock.
+  wakeone(lk);
   release(&lk->lk);
 }
 
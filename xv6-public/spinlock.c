@@ -8,13 +8,55 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Statistics, per lock name and per CPU so that counting needs no
+// atomic instructions or shared cache lines.  Names are registered
+// by initlock(); once NLOCKSTAT names are known, further names are
+// counted with the last one.
+struct lstat {
+  uint nacquire;
+  uint ncontended;
+  uint64 wait;
+  uint64 hold;
+};
+
+static struct {
+  uint locked;              // Protects name and n; a plain xchg lock
+  char *name[NLOCKSTAT];
+  int n;
+  struct lstat stat[NCPU][NLOCKSTAT];
+} lstats;
+
+// Return the statistics slot for locks called name.
+static int
+lstatslot(char *name)
+{
+  int i;
+
+  while(xchg(&lstats.locked, 1) != 0)
+    ;
+  for(i = 0; i < lstats.n; i++)
+    if(strncmp(lstats.name[i], name, sizeof(((struct lockstat*)0)->name)) == 0)
+      break;
+  if(i == lstats.n){
+    if(lstats.n < NLOCKSTAT)
+      lstats.name[lstats.n++] = name;
+    else
+      i = NLOCKSTAT - 1;
+  }
+  xchg(&lstats.locked, 0);
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = lstatslot(name);
 }
 
 // Acquire the lock.
@@ -24,13 +66,26 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lstat *st;
+  uint ticket, t0, n;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
-
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  st = &lstats.stat[cpuid()][lk->stat];
+
+  // The locked add is atomic.  Waiters only read owner, and back
+  // off in proportion to their place in line, so that the cache
+  // line is not hammered.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  if(*(volatile uint*)&lk->owner != ticket){
+    t0 = rdtsc();
+    while((n = ticket - *(volatile uint*)&lk->owner) != 0)
+      while(n-- > 0)
+        pause();
+    st->ncontended++;
+    st->wait += (uint)rdtsc() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +95,8 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+  st->nacquire++;
+  lk->tacquire = rdtsc();
 }
 
 // Release the lock.
@@ -49,6 +106,7 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  lstats.stat[cpuid()][lk->stat].hold += (uint)rdtsc() - lk->tacquire;
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,14 +117,49 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Let the next ticket in, equivalent to lk->owner++.  Only the
+  // holder writes owner, so the increment need not be locked, but
+  // it must be a single store.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
 
+// Copy to the user array dst the statistics of up to n lock names,
+// summed over all CPUs, then clear them if reset.  Returns the number
+// of names copied, or -1 if dst faults.
+int
+lockstat(char *dst, int n, int reset)
+{
+  struct lockstat st;
+  struct lstat *s;
+  uint64 wait, hold;
+  int i, c;
+
+  if(n > lstats.n)
+    n = lstats.n;
+  for(i = 0; i < n; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, lstats.name[i], sizeof(st.name));
+    wait = hold = 0;
+    for(c = 0; c < ncpu; c++){
+      s = &lstats.stat[c][i];
+      st.nacquire += s->nacquire;
+      st.ncontended += s->ncontended;
+      wait += s->wait;
+      hold += s->hold;
+    }
+    st.kwait = wait >> 10;
+    st.khold = hold >> 10;
+    if(copyuser(dst + i * sizeof(st), &st, sizeof(st)) < 0)
+      return -1;
+  }
+  if(reset)
+    for(c = 0; c < ncpu; c++)
+      memset(lstats.stat[c], 0, sizeof(lstats.stat[c]));
+  return n;
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -91,7 +184,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->next != lock->owner && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -1,11 +1,18 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and waits until
+// owner reaches it, so CPUs get the lock in the order they asked.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now holding the lock
+                     // (held while next != owner)
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  // For lockstat():
+  int stat;          // Statistics slot of the lock's name
+  uint tacquire;     // Low half of the TSC when acquired
+};
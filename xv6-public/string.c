@@ -103,3 +103,15 @@ strlen(const char *s)
   return n;
 }
 
+
+// Return sum/n, or 0 if n is 0, without 64-bit division, which the
+// kernel lacks.  Both are halved until sum fits in 32 bits.
+uint
+avg64(uint64 sum, uint n)
+{
+  while(sum >> 32){
+    sum >>= 1;
+    n >>= 1;
+  }
+  return n > 0 ? (uint)sum / n : 0;
+}
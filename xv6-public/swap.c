@@ -0,0 +1,274 @@
+// Paging user memory out to disk.
+//
+// mkfs reserves a swap area of NSWAP blocks after the file system
+// (sb.swapstart, sb.nswap), used as page-sized slots.  When kalloc()
+// runs dry for a user page, the faulting process pages something out
+// itself and wakes the kswapd kernel process, which goes on until
+// SWAPHIGH pages are free.  Victims come from a clock scan over the
+// processes (swapvictim() in proc.c) that gives every page with
+// PTE_A set a second chance.  The victim's PTE becomes a swap entry,
+// PTE_SWAP plus the slot number, and the next fault on it reads the
+// page back in (swapin()).  Slots are read and written through
+// bufs of swap.c's own, not the buffer cache, so that paging does
+// not push file blocks out of it.
+//
+// Only pages mapped exactly once (refcount 1) from a private page
+// table are paged out, so pages still shared copy-on-write after
+// fork stay in memory.  Swap entries themselves can be copied by
+// fork or a page-table split, so slots are reference counted like
+// pages; each process that faults a shared slot in gets its own copy.
+//
+// A process is paged out only while p->uidle is set, i.e. while the
+// kernel holds no pointer into its memory: when it was preempted in
+// user mode, or while it waits in wait(), sleep() or a console read.
+// A process blocked in piperead() or pipewrite() stays resident,
+// since the pipe copies run under the pipe's spinlock, where faulting
+// a page back in could not sleep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "swapstat.h"
+
+#define SLOTBLOCKS  (PGSIZE / BSIZE)
+#define MAXSLOT     (PGSIZE / sizeof(ushort))
+
+struct {
+  struct spinlock lock;
+  uint start;           // First block of the swap area
+  int nslot;            // 0 until kswapd has read the super block
+  ushort *ref;          // Swap entries naming each slot (atomic)
+  uchar *busy;          // Slot is being written out
+  int hand;             // Where to look for a free slot next
+  int want;             // kswapd has been asked to page out
+  uint nout;            // Pages written out
+  uint nin;             // Pages read back in
+  struct buf iobuf[SLOTBLOCKS];  // For one slot's I/O at a time
+} swap;
+
+static void kswapd(void);
+
+void
+swapinit(void)
+{
+  int i;
+
+  initlock(&swap.lock, "swap");
+  for(i = 0; i < SLOTBLOCKS; i++)
+    initsleeplock(&swap.iobuf[i].lock, "swapbuf");
+  if((swap.ref = (ushort*)kalloc()) == 0 || (swap.busy = (uchar*)kalloc()) == 0)
+    panic("swapinit");
+  memset(swap.ref, 0, PGSIZE);
+  memset(swap.busy, 0, PGSIZE);
+  kproc("kswapd", kswapd);
+}
+
+// Take another reference to the slot of swap entry e.
+void
+swapdup(uint e)
+{
+  __sync_fetch_and_add(&swap.ref[SWAPSLOT(e)], 1);
+}
+
+// Drop a reference to the slot of swap entry e.  Does not lock,
+// so that page tables can be freed with ptable.lock held.
+void
+swapfree(uint e)
+{
+  __sync_fetch_and_sub(&swap.ref[SWAPSLOT(e)], 1);
+}
+
+// Page faults may take a while to handle here only if the kernel
+// holds no spinlocks: reading and writing swap sleeps.
+static int
+cansleep(void)
+{
+  int locked;
+
+  pushcli();
+  locked = mycpu()->ncli > 1;
+  popcli();
+  return !locked && myproc() != 0;
+}
+
+// Read or write the page mem from or to slot.  The bufs are taken
+// in order, so one process at a time has all of them.
+static void
+swaprw(char *mem, int slot, int write)
+{
+  struct buf *b;
+  int i;
+
+  for(i = 0; i < SLOTBLOCKS; i++){
+    b = &swap.iobuf[i];
+    acquiresleep(&b->lock);
+    b->dev = ROOTDEV;
+    b->blockno = swap.start + slot*SLOTBLOCKS + i;
+    b->flags = 0;
+    if(write){
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+      b->flags = B_DIRTY;
+    }
+  }
+  // The slot's blocks are consecutive, so the disk moves them in
+  // one or two transfers.
+  iderwv(swap.iobuf, SLOTBLOCKS);
+  for(i = 0; i < SLOTBLOCKS; i++){
+    b = &swap.iobuf[i];
+    if(!write)
+      memmove(mem + i*BSIZE, b->data, BSIZE);
+    releasesleep(&b->lock);
+  }
+}
+
+// Write one user page out to a free slot.
+// Returns 0 on success, -1 if there is no slot or no victim.
+static int
+pageout(void)
+{
+  uint pa;
+  int i, slot;
+
+  acquire(&swap.lock);
+  slot = -1;
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.hand + i) % swap.nslot;
+    if(swap.ref[slot] == 0 && !swap.busy[slot])
+      break;
+  }
+  if(i == swap.nslot){
+    release(&swap.lock);
+    return -1;
+  }
+  swap.hand = (slot + 1) % swap.nslot;
+  swap.ref[slot] = 1;
+  swap.busy[slot] = 1;
+  release(&swap.lock);
+
+  if((pa = swapvictim(SWAPPTE(slot))) == 0){
+    acquire(&swap.lock);
+    swap.ref[slot] = 0;
+    swap.busy[slot] = 0;
+    release(&swap.lock);
+    return -1;
+  }
+
+  swaprw(P2V(pa), slot, 1);
+  kfree(P2V(pa));
+
+  acquire(&swap.lock);
+  swap.busy[slot] = 0;
+  swap.nout++;
+  release(&swap.lock);
+  wakeup(&swap.busy[slot]);
+  return 0;
+}
+
+// kalloc() for a user page.  If memory has run out and the caller
+// may sleep, wake kswapd and page something out right here.
+// Returns 0 if there is still no memory.
+char*
+swapkalloc(void)
+{
+  char *mem;
+
+  while((mem = kalloc()) == 0){
+    // wakeup() takes ptable.lock, which the caller may hold if
+    // it may not sleep.
+    if(!cansleep())
+      return 0;
+    acquire(&swap.lock);
+    swap.want = 1;
+    wakeup(&swap);
+    release(&swap.lock);
+    if(pageout() < 0)
+      return 0;
+  }
+  return mem;
+}
+
+// If the PTE of va in pgdir is a swap entry, read the page back
+// in and map it with the permissions it had.
+// Returns 0 on success, -1 if va is not swapped out or on error.
+int
+swapin(pde_t *pgdir, uint va)
+{
+  pte_t *pte, e;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & PTE_P) || !(*pte & PTE_SWAP) || !cansleep())
+    return -1;
+  // The page table may be shared after fork; get our own.
+  if((pte = walkpgdir(pgdir, (char*)va, 1)) == 0)
+    return -1;
+  e = *pte;
+
+  acquire(&swap.lock);
+  while(swap.busy[SWAPSLOT(e)])
+    sleep(&swap.busy[SWAPSLOT(e)], &swap.lock);
+  release(&swap.lock);
+
+  if((mem = swapkalloc()) == 0)
+    return -1;
+  swaprw(mem, SWAPSLOT(e), 0);
+  *pte = V2P(mem) | (PTE_FLAGS(e) & ~PTE_SWAP) | PTE_P;
+  swapfree(e);
+  flushtlb(pgdir);
+
+  acquire(&swap.lock);
+  swap.nin++;
+  release(&swap.lock);
+  return 0;
+}
+
+// The page-out daemon.  Sleeps until kalloc() runs dry, then pages
+// out until SWAPHIGH pages are free or nothing more can go.
+// swap.want, set and tested under swap.lock, makes sure a request
+// made while kswapd is busy is not lost.
+static void
+kswapd(void)
+{
+  struct superblock sb;
+
+  readsb(ROOTDEV, &sb);
+  acquire(&swap.lock);
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / SLOTBLOCKS;
+  if(swap.nslot > MAXSLOT)
+    swap.nslot = MAXSLOT;
+  for(;;){
+    while(!swap.want)
+      sleep(&swap, &swap.lock);
+    swap.want = 0;
+    release(&swap.lock);
+    while(getNumFreePages() < SWAPHIGH && pageout() == 0)
+      ;
+    acquire(&swap.lock);
+  }
+}
+
+void
+swapstat(struct swapstat *st)
+{
+  int i;
+
+  acquire(&swap.lock);
+  st->nslot = swap.nslot;
+  st->nused = 0;
+  for(i = 0; i < swap.nslot; i++)
+    if(swap.ref[i] != 0)
+      st->nused++;
+  st->nout = swap.nout;
+  st->nin = swap.nin;
+  release(&swap.lock);
+}
@@ -0,0 +1,7 @@
+// Swap statistics, returned by swapstat().
+struct swapstat {
+  uint nslot;     // Page-sized slots in the swap area
+  uint nused;     // Slots holding a paged-out page
+  uint nout;      // Pages written out to swap
+  uint nin;       // Pages read back in
+};
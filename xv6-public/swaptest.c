@@ -0,0 +1,50 @@
+// Swap test: map more anonymous memory than is free, write a
+// different value into every page, then read them all back.
+// Without swap the faults past the end of memory kill the process.
+//
+// usage: swaptest [extra pages]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mman.h"
+#include "swapstat.h"
+
+#define PGSIZE 4096
+
+int
+main(int argc, char *argv[])
+{
+  struct swapstat s0, s1;
+  int extra, npages, i, bad;
+  char *p;
+
+  extra = argc > 1 ? atoi(argv[1]) : 512;
+  swapstat(&s0);
+  npages = getNumFreePages() + extra;
+  printf(1, "swaptest: %d free pages, touching %d, %d swap slots\n",
+         getNumFreePages(), npages, s0.nslot);
+
+  p = mmap(0, npages * PGSIZE, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(p == 0){
+    printf(1, "swaptest: mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < npages; i++)
+    *(int*)(p + i * PGSIZE) = i;
+  bad = 0;
+  for(i = 0; i < npages; i++)
+    if(*(int*)(p + i * PGSIZE) != i)
+      bad++;
+  swapstat(&s1);
+
+  printf(1, "paged out %d, paged in %d, %d slots in use\n",
+         s1.nout - s0.nout, s1.nin - s0.nin, s1.nused);
+  if(bad)
+    printf(1, "swaptest: %d pages corrupted\n", bad);
+  else
+    printf(1, "swaptest ok\n");
+  munmap(p, npages * PGSIZE);
+  exit();
+}
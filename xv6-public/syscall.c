@@ -13,6 +13,12 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Every user address the kernel is handed must be checked to lie
+// below sz and to be backed by memory.  mmap'd pages are faulted in
+// here, where sleeping is safe, and holes left by munmap are
+// rejected.  The kernel then only touches user memory through
+// copyuser(), which fails with -1 on a fault trap() cannot fix.
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
@@ -21,26 +27,37 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  if(mmapprefault(curproc, addr, 4, 0) < 0)
+    return -1;
+  return copyuser(ip, (void*)addr, 4);
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
+// Copy the nul-terminated string at addr from the current process
+// into buf, which holds max bytes.
 // Returns length of string, not including nul.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
-  char *s, *ep;
+  uint a, m;
+  char *s;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
-    return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
+  for(a = addr; a - addr < max; a += m){
+    if(a >= curproc->sz)
+      return -1;
+    // One page at a time, so as not to run past the string into
+    // a hole.
+    m = PGSIZE - a % PGSIZE;
+    if(m > max - (a - addr))
+      m = max - (a - addr);
+    if(m > curproc->sz - a)
+      m = curproc->sz - a;
+    if(mmapprefault(curproc, a, m, 0) < 0 ||
+       copyuser(buf + (a - addr), (void*)a, m) < 0)
+      return -1;
+    for(s = buf + (a - addr); s < buf + (a - addr) + m; s++)
+      if(*s == 0)
+        return s - buf;
   }
   return -1;
 }
@@ -52,11 +69,8 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+static int
+argmem(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
@@ -65,21 +79,39 @@ argptr(int n, char **pp, int size)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  if(mmapprefault(curproc, i, size, write) < 0)
+    return -1;
   *pp = (char*)i;
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space.
+int
+argptr(int n, char **pp, int size)
+{
+  return argmem(n, pp, size, 0);
+}
+
+// Like argptr, for memory the kernel is going to write to:
+// it must also be writable by the process.
+int
+argwptr(int n, char **pp, int size)
+{
+  return argmem(n, pp, size, 1);
+}
+
+// Fetch the nth word-sized system call argument as a string pointer,
+// and copy the string into buf, which holds max bytes.  Working on a
+// copy, the kernel sees no later change to shared memory.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  return fetchstr(addr, buf, max);
 }
 
 extern int sys_chdir(void);
@@ -108,10 +140,22 @@ extern int sys_numvp(void);
 extern int sys_numpp(void);
 extern int sys_getptsize(void);
 extern int sys_mmap(void);
-extern int sys_mapshared(void);
-extern int sys_getshared(void);
-extern int sys_unmapshared(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
 extern int sys_getNumFreePages(void);
+extern int sys_munmap(void);
+extern int sys_faultaround(void);
+extern int sys_pgfaults(void);
+extern int sys_bstat(void);
+extern int sys_logstat(void);
+extern int sys_setpriority(void);
+extern int sys_schedstat(void);
+extern int sys_swapstat(void);
+extern int sys_lockstat(void);
+extern int sys_prof(void);
+extern int sys_vmstat(void);
+extern int sys_shmrm(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -140,10 +184,22 @@ static int (*syscalls[])(void) = {
 [SYS_numpp]   sys_numpp,
 [SYS_getptsize] sys_getptsize,
 [SYS_mmap]    sys_mmap,
-[SYS_mapshared] sys_mapshared,
-[SYS_getshared] sys_getshared,
-[SYS_unmapshared] sys_unmapshared,
+[SYS_shmget] sys_shmget,
+[SYS_shmat] sys_shmat,
+[SYS_shmdt] sys_shmdt,
 [SYS_getNumFreePages] sys_getNumFreePages,
+[SYS_munmap]  sys_munmap,
+[SYS_faultaround] sys_faultaround,
+[SYS_pgfaults] sys_pgfaults,
+[SYS_bstat]   sys_bstat,
+[SYS_logstat] sys_logstat,
+[SYS_setpriority] sys_setpriority,
+[SYS_schedstat] sys_schedstat,
+[SYS_swapstat] sys_swapstat,
+[SYS_lockstat] sys_lockstat,
+[SYS_prof]    sys_prof,
+[SYS_vmstat]  sys_vmstat,
+[SYS_shmrm]   sys_shmrm,
 };
 
 void
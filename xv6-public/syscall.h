@@ -25,7 +25,19 @@
 #define SYS_numpp  24
 #define SYS_getptsize  25
 #define SYS_mmap   26
-#define SYS_mapshared 27
-#define SYS_getshared 28
-#define SYS_unmapshared 29
+#define SYS_shmget 27
+#define SYS_shmat 28
+#define SYS_shmdt 29
 #define SYS_getNumFreePages 30
+#define SYS_munmap 31
+#define SYS_faultaround 32
+#define SYS_pgfaults 33
+#define SYS_bstat  34
+#define SYS_logstat 35
+#define SYS_setpriority 36
+#define SYS_schedstat 37
+#define SYS_swapstat 38
+#define SYS_lockstat 39
+#define SYS_prof   40
+#define SYS_vmstat 41
+#define SYS_shmrm  42
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
+#include "bstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -73,7 +75,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -107,21 +109,25 @@ int
 sys_fstat(void)
 {
   struct file *f;
-  struct stat *st;
+  struct stat st;
+  char *p;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, &p, sizeof(st)) < 0)
     return -1;
-  return filestat(f, st);
+  memset(&st, 0, sizeof(st));  // no stack garbage in the padding
+  if(filestat(f, &st) < 0)
+    return -1;
+  return copyuser(p, &st, sizeof(st));
 }
 
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -171,10 +177,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  // "." and ".." come first, except in a hashed directory.
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -185,11 +192,10 @@ int
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -215,9 +221,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -274,8 +278,18 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // dp's hash table is full: free ip again.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
@@ -285,12 +299,12 @@ create(char *path, short type, short major, short minor)
 int
 sys_open(void)
 {
-  char *path;
+  char path[MAXPATH];
   int fd, omode;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
     return -1;
 
   begin_op();
@@ -335,11 +349,11 @@ sys_open(void)
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -352,11 +366,11 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int major, minor;
 
   begin_op();
-  if((argstr(0, &path)) < 0 ||
+  if((argstr(0, path, MAXPATH)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
      (ip = create(path, T_DEV, major, minor)) == 0){
@@ -371,12 +385,12 @@ sys_mknod(void)
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   struct proc *curproc = myproc();
   
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
   }
@@ -396,37 +410,45 @@ sys_chdir(void)
 int
 sys_exec(void)
 {
-  char *path, *argv[MAXARG];
-  int i;
+  char path[MAXPATH], *argv[MAXARG];
+  int i, r;
   uint uargv, uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, (int*)&uargv) < 0){
     return -1;
   }
   memset(argv, 0, sizeof(argv));
+  // Each argument is copied to a kernel page, so that exec()
+  // does not read user memory itself.
+  r = -1;
   for(i=0;; i++){
     if(i >= NELEM(argv))
-      return -1;
+      goto bad;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
-      return -1;
+      goto bad;
     if(uarg == 0){
       argv[i] = 0;
       break;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
-      return -1;
+    if((argv[i] = kalloc()) == 0 || fetchstr(uarg, argv[i], PGSIZE) < 0)
+      goto bad;
   }
-  return exec(path, argv);
+  r = exec(path, argv);
+
+ bad:
+  for(i = 0; i < NELEM(argv) && argv[i]; i++)
+    kfree(argv[i]);
+  return r;
 }
 
 int
 sys_pipe(void)
 {
-  int *fd;
+  char *p;
   struct file *rf, *wf;
-  int fd0, fd1;
+  int fd[2], fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, &p, sizeof(fd)) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -440,5 +462,105 @@ sys_pipe(void)
   }
   fd[0] = fd0;
   fd[1] = fd1;
+  if(copyuser(p, fd, sizeof(fd)) < 0){
+    myproc()->ofile[fd0] = 0;
+    myproc()->ofile[fd1] = 0;
+    fileclose(rf);
+    fileclose(wf);
+    return -1;
+  }
   return 0;
 }
+
+// Map len bytes of a file, or of zeroed memory with MAP_ANONYMOUS,
+// into the address space:  mmap(addr, len, prot, flags, fd, off).
+// len must be a positive multiple of PGSIZE and off page aligned.
+// addr is only a hint.  Pages are faulted in on first access.
+// Returns the starting virtual address, or 0 on error.
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off;
+  struct file *f;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return 0;
+  if(len <= 0 || len % PGSIZE != 0 || off < 0 || off % PGSIZE != 0)
+    return 0;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return 0;
+  // 4MB pages: anonymous, read-write, whole pages only.
+  if((flags & MAP_HUGE) && (!(flags & MAP_ANONYMOUS) ||
+     !(prot & PROT_WRITE) || len % HUGEPGSIZE != 0))
+    return 0;
+
+  f = 0;
+  if(!(flags & MAP_ANONYMOUS)){
+    if(argfd(4, 0, &f) < 0 || f->type != FD_INODE || !f->readable)
+      return 0;
+    if(f->ip->type != T_FILE)
+      return 0;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return 0;
+  }
+  return mmapregion(myproc(), addr, len, prot, flags, f, off);
+}
+
+// Unmap [addr, addr+len) from any mmap'd regions, writing
+// MAP_SHARED file pages back first.  Returns 0, or -1 on error.
+int
+sys_munmap(void)
+{
+  int addr, len;
+  uint sz;
+  pte_t *pte;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || len <= 0 || (uint)addr + len < (uint)addr)
+    return -1;
+  if(munmapregion(curproc, addr, PGROUNDUP((uint)addr + len)) < 0)
+    return -1;
+  // Give back the top of the address space if it is now empty.
+  sz = PGROUNDUP(curproc->sz);
+  while(sz > (uint)addr && findvma(curproc, sz - PGSIZE) == 0){
+    pte = walkpgdir(curproc->pgdir, (char*)(sz - PGSIZE), 0);
+    if(pte && (*pte & PTE_P))
+      break;
+    sz -= PGSIZE;
+  }
+  if(sz < curproc->sz)
+    curproc->sz = sz;
+  flushtlb(curproc->pgdir);
+  return 0;
+}
+
+// Copy buffer cache statistics to the user, clearing the counts
+// afterwards if reset is set.
+int
+sys_bstat(void)
+{
+  struct bstat st;
+  char *p;
+  int reset;
+
+  if(argwptr(0, &p, sizeof(st)) < 0 || argint(1, &reset) < 0)
+    return -1;
+  bstat(&st, reset);
+  return copyuser(p, &st, sizeof(st));
+}
+
+// Copy log statistics to the user.
+int
+sys_logstat(void)
+{
+  struct logstat st;
+  char *p;
+
+  if(argwptr(0, &p, sizeof(st)) < 0)
+    return -1;
+  logstat(&st);
+  return copyuser(p, &st, sizeof(st));
+}
@@ -6,6 +6,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "schedstat.h"
+#include "swapstat.h"
+#include "lockstat.h"
+#include "prof.h"
+#include "vmstat.h"
 
 // Forward declarations for helper functions in vm.c
 extern uint countppages(pde_t*, uint);
@@ -75,7 +80,9 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
+    myproc()->uidle = 1;
     sleep(&ticks, &tickslock);
+    myproc()->uidle = 0;
   }
   release(&tickslock);
   return 0;
@@ -129,7 +136,9 @@ sys_numpp(void)
 }
 
 // Return the size of the page table in terms of pages
-// This includes the page directory and all allocated page table pages
+// This includes the page directory and all allocated page table pages,
+// but not page table pages still shared with a fork parent or child,
+// so the drop after fork() shows how many pages SHAREPT saved.
 int
 sys_getptsize(void)
 {
@@ -138,107 +147,170 @@ sys_getptsize(void)
   return countpagepages(p->pgdir);
 }
 
-// Memory map system call - expand virtual address space without allocating physical memory
-// Takes one argument: number of bytes to map
-// Returns starting virtual address of the new memory region, or 0 on error
+// Create or open the shared-memory segment key of npages pages.
+// Returns its id, or -1 on error.
 int
-sys_mmap(void)
+sys_shmget(void)
 {
-  int n;
+  int key, npages;
+
+  if(argint(0, &key) < 0 || argint(1, &npages) < 0)
+    return -1;
+  return shmget(key, npages);
+}
+
+// Attach segment id at addr, or at the end of the address space
+// if addr is 0.  Returns the address on success, 0 on failure.
+int
+sys_shmat(void)
+{
+  int id, addr;
+  uint va;
   struct proc *p = myproc();
-  uint new_addr;
-  
-  // Get the argument (number of bytes to map)
-  if(argint(0, &n) < 0)
-    return 0;
-  
-  // Validate input: must be positive and multiple of PGSIZE
-  if(n <= 0 || (n % PGSIZE) != 0)
-    return 0;
-  
-  // Check if sz + n would exceed KERNBASE
-  if(p->sz + n >= KERNBASE)
+
+  if(argint(0, &id) < 0 || argint(1, &addr) < 0)
     return 0;
-  
-  // Store the starting address before incrementing
-  new_addr = p->sz;
-  
-  // Expand process size WITHOUT allocating physical memory
-  // The page fault handler in trap.c will allocate pages on demand
-  // when the user accesses them
-  p->sz += n;
-  
-  // Update mmap region bounds to track all mapped memory
-  // (This allows the page fault handler to know if an address
-  // should be on-demand allocated)
-  if(p->mmap_start == 0)
-    p->mmap_start = new_addr;
-  p->mmap_end = p->sz;
-  
-  return new_addr;
+  va = shmattach(p, id, addr);
+  flushtlb(p->pgdir);
+  return va;
 }
 
-// Prototypes for VM helpers defined in vm.c
-extern int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
-extern int find_shared(pde_t *pgdir, uint sz);
-extern int unmap_shared(pde_t *pgdir, uint sz);
-
-// Create a shared page at the end of the calling process's user address
-// space. Returns the starting virtual address on success, 0 on failure.
+// Detach the segment attached at addr.
+// Returns 0 on success, -1 on error.
 int
-sys_mapshared(void)
+sys_shmdt(void)
 {
+  int addr;
   struct proc *p = myproc();
-  char *addr;
-  char *mem;
 
-  // Map at end of address space
-  addr = (char*)p->sz;
-  if((uint)addr + PGSIZE >= KERNBASE)
-    return 0;
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(shmdetach(p, addr) < 0)
+    return -1;
+  flushtlb(p->pgdir);
+  return 0;
+}
 
-  mem = kalloc();
-  if(mem == 0)
-    return 0;
-  memset(mem, 0, PGSIZE);
+// Remove segment id once nothing is attached to it.
+// Returns 0 on success, -1 on error.
+int
+sys_shmrm(void)
+{
+  int id;
 
-  if(mappages(p->pgdir, addr, PGSIZE, V2P(mem), PTE_W|PTE_U|PTE_S) < 0){
-    kfree(mem);
-    return 0;
-  }
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmrm(id);
+}
 
-  p->sz += PGSIZE;
-  return (int)addr;
+int
+sys_getNumFreePages(void)
+{
+  return getNumFreePages();
 }
 
-// Return the virtual address of the shared page in this process, or 0 if none
+// Set how many pages after a faulting mmap page are mapped along
+// with it (0 disables fault-around); n < 0 leaves it unchanged.
+// Returns the previous setting.
 int
-sys_getshared(void)
+sys_faultaround(void)
 {
+  int n, old;
   struct proc *p = myproc();
-  int vaddr = find_shared(p->pgdir, p->sz);
-  if(vaddr < 0)
-    return 0;
-  return vaddr;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  old = p->faultaround;
+  if(n >= 0)
+    p->faultaround = n < MAXFAULTAROUND ? n : MAXFAULTAROUND;
+  return old;
 }
 
-// Unmap the shared page from this process and free its physical memory.
-// Returns 0 on success, -1 on error.
+// Return the number of page faults this process has taken
 int
-sys_unmapshared(void)
+sys_pgfaults(void)
 {
-  struct proc *p = myproc();
-  int vaddr = unmap_shared(p->pgdir, p->sz);
-  if(vaddr < 0)
+  return myproc()->vmcount[VM_FAULT];
+}
+
+// Set the scheduling level (0 is highest) of process pid.
+// Returns the old level, or -1 on error.
+int
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
     return -1;
-  // If the shared page was at the end of the address space, shrink sz
-  if((uint)vaddr + PGSIZE == p->sz)
-    p->sz -= PGSIZE;
-  return 0;
+  return setpriority(pid, prio);
 }
 
+// Copy scheduler statistics to the user.
 int
-sys_getNumFreePages(void)
+sys_schedstat(void)
 {
-  return getNumFreePages();
+  struct schedstat st;
+  char *p;
+
+  if(argwptr(0, &p, sizeof(st)) < 0)
+    return -1;
+  schedstat(&st);
+  return copyuser(p, &st, sizeof(st));
+}
+
+// Copy swap statistics to the user.
+int
+sys_swapstat(void)
+{
+  struct swapstat st;
+  char *p;
+
+  if(argwptr(0, &p, sizeof(st)) < 0)
+    return -1;
+  swapstat(&st);
+  return copyuser(p, &st, sizeof(st));
+}
+
+// Copy the statistics of up to n lock names to the user, clearing
+// them afterwards if reset is set.  Returns the number copied.
+int
+sys_lockstat(void)
+{
+  char *dst;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0 || n > NLOCKSTAT ||
+     argwptr(0, &dst, n * sizeof(struct lockstat)) < 0)
+    return -1;
+  return lockstat(dst, n, reset);
+}
+
+// Start or stop the profiler, or copy up to n samples to the user.
+int
+sys_prof(void)
+{
+  char *dst;
+  int cmd, n;
+
+  if(argint(0, &cmd) < 0 || argint(2, &n) < 0 || n < 0 ||
+     n > NCPU*NPROFSAMPLE)
+    return -1;
+  if(argwptr(1, &dst, n * sizeof(struct profsample)) < 0)
+    return -1;
+  return prof(cmd, dst, n);
+}
+
+// Copy the VM event counts to the user, then clear the
+// system-wide ones if reset is set.
+int
+sys_vmstat(void)
+{
+  struct vmstat st;
+  char *p;
+  int reset;
+
+  if(argwptr(0, &p, sizeof(st)) < 0 || argint(1, &reset) < 0)
+    return -1;
+  vmstat(&st, reset);
+  return copyuser(p, &st, sizeof(st));
 }
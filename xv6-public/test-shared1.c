@@ -1,14 +1,15 @@
 #include "types.h"
 #include "user.h"
 
+// A one-page segment attached before fork is shared with the child.
 int main(int argc, char *argv[]) 
 { 
-  uint *ap = (uint *) mapshared();
+  uint *ap = (uint *) shmat(shmget(1, 1), 0);
   int pid = fork();
 
   if(pid == 0) {
     sleep(1); //wait for parent
-    uint *ac = (uint *) getshared();
+    uint *ac = ap;
     printf(1, "child %d\n", *ac);
     *ac = 53;
     sleep(10);
@@ -18,7 +19,7 @@ int main(int argc, char *argv[])
     *ap = 42;
     sleep(5);
     printf(1, "parent %d\n", *ap);
-    if(unmapshared() < 0)
+    if(shmdt(ap) < 0)
       printf(1, "could not unmap shared page\n");
     wait();
   }
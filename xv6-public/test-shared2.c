@@ -1,30 +1,74 @@
 #include "types.h"      
 #include "user.h"
 
+// Producer/consumer over a 1MB segment.  The child opens the segment
+// by key and attaches it at an address of its own choosing.
+#define KEY    2
+#define NPAGES 256
+#define WORDS  (NPAGES*4096/sizeof(uint))
+#define ADDR   ((void*)0x10000000)
+
+// Fill the segment with v, v+1, ...
+void
+fill(uint *p, uint v)
+{
+  uint i;
+
+  for(i = 0; i < WORDS; i++)
+    p[i] = v + i;
+}
+
+// Return 1 if the segment holds v, v+1, ...
+int
+check(uint *p, uint v)
+{
+  uint i;
+
+  for(i = 0; i < WORDS; i++)
+    if(p[i] != v + i)
+      return 0;
+  return 1;
+}
+
 int main(int argc, char *argv[]) 
 { 
-  uint *ap = (uint *) mapshared();
+  int id = shmget(KEY, NPAGES);
+  uint *ap = (uint *) shmat(id, 0);
+  if(ap == 0){
+    printf(1, "could not attach shared segment\n");
+    exit();
+  }
   int pid = fork();
+  int nid;
 
   if(pid == 0) {
-    sleep(2); //wait for parent to write
-    uint *ac = (uint *) getshared();
-    printf(1, "child %d\n", *ac);
-    *ac = 53;
-    sleep(10);
-    printf(1, "child again %d\n", *ac);
-    *ac = 54;
-    sleep(20); //sleep to give parent time to unmap
+    shmdt(ap);
+    uint *ac = (uint *) shmat(shmget(KEY, NPAGES), ADDR);
+    if(ac != ADDR){
+      printf(1, "child could not attach shared segment\n");
+      exit();
+    }
+    sleep(20); //wait for parent to write
+    printf(1, "child %d %s\n", *ac, check(ac, 42) ? "ok" : "BAD");
+    fill(ac, 53);
+    sleep(100);
+    printf(1, "child again %d %s\n", *ac, check(ac, 43) ? "ok" : "BAD");
+    fill(ac, 54);
+    sleep(200); //sleep to give parent time to unmap
   }
 
   else {
-    *ap = 42;
-    sleep(5); //wait for child to reply
-    printf(1, "parent %d\n", *ap);
-    *ap = 43; //write again
-    sleep(10);
-    printf(1, "parent again %d\n", *ap);
-    if(unmapshared() < 0)
+    fill(ap, 42);
+    sleep(50); //wait for child to reply
+    printf(1, "parent %d %s\n", *ap, check(ap, 53) ? "ok" : "BAD");
+    fill(ap, 43); //write again
+    sleep(100);
+    printf(1, "parent again %d %s\n", *ap, check(ap, 54) ? "ok" : "BAD");
+    // The segment outlives this while the child is attached, but
+    // the key now makes a new one.
+    if(shmrm(id) < 0 || (nid = shmget(KEY, 1)) == id || shmrm(nid) < 0)
+      printf(1, "could not remove shared segment\n");
+    if(shmdt(ap) < 0)
       printf(1, "could not unmap shared page\n");
     wait();
   }
@@ -7,12 +7,15 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "mman.h"
+#include "vmstat.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+uint64 tickcycles;      // TSC cycles timer interrupts spent in wakeup()
 
 void
 tvinit(void)
@@ -36,6 +39,8 @@ idtinit(void)
 void
 trap(struct trapframe *tf)
 {
+  uint64 t0;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -48,10 +53,19 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    if(profintr(tf)){
+      // Not a clock tick, so no yield, but still honor kill.
+      lapiceoi();
+      if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
+        exit();
+      return;
+    }
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
+      t0 = rdtsc();
       wakeup(&ticks);
+      tickcycles += rdtsc() - t0;
       release(&tickslock);
     }
     lapiceoi();
@@ -80,33 +94,64 @@ trap(struct trapframe *tf)
 
   //PAGEBREAK: 13
   case T_PGFLT:
-    // Handle page fault: first check for CoW, then on-demand allocation
-    if(myproc() != 0 && (tf->cs&3) == DPL_USER){
+    // Handle page fault: first check for CoW, then on-demand allocation.
+    // The kernel can fault here too, when a system call writes into
+    // user memory that is copy-on-write or not yet allocated (e.g.
+    // read() into a fresh buffer); that is handled the same way.
+    if(myproc() != 0){
       uint va = rcr2();  // Get the faulting virtual address
       struct proc *p = myproc();
 
+      vmcount(VM_FAULT, 1);
+
       // Only consider user addresses that are within the process's
       // virtual address space (below p->sz) and below kernel base.
       if(va < p->sz && va < KERNBASE){
-        // First try to handle CoW fault
-        extern int cowfault(pde_t*, uint);
-        if(cowfault(p->pgdir, va) == 0){
-          // CoW handled successfully - return to user to retry
-          return;
-        }
-        
-        // If not a CoW fault, try on-demand allocation
-        extern int allocuvm_ondemand(pde_t*, uint);
-        if(allocuvm_ondemand(p->pgdir, va) == 0){
-          // Success - update CR3/TLB and return to user to retry
-          switchuvm(p);
+        struct vma *v = findvma(p, va);
+        int r = -1;
+
+        // Writes to a read-only mapping are never fixed up
+        if((tf->err & FEC_WR) && v && !(v->prot & PROT_WRITE))
+          goto unfixable;
+
+        // While a fault from user mode is handled, the kernel holds
+        // no pointers into user memory, so making room for the page
+        // may page out the process's own pages too.
+        p->uidle = (tf->cs&3) == DPL_USER;
+
+        // A paged-out page comes back first; a write to it may
+        // fault again below
+        if(swapin(p->pgdir, va) == 0)
+          r = 0;
+        // Then try to handle CoW fault
+        else if((tf->err & FEC_WR) && cowfault(p->pgdir, va) == 0)
+          r = 0;
+        // If not a CoW fault, fill in the page of an mmap'd region
+        else if(v && mmapfault(p, v, va, tf->err & FEC_WR) == 0)
+          r = 0;
+
+        p->uidle = 0;
+        // Success: return to retry.  The handlers have flushed
+        // the TLB themselves where a mapping changed.
+        if(r == 0)
           return;
-        }
       }
-      
+
+unfixable:
+      // The kernel only touches user memory through copyuser(), which
+      // fails instead, e.g. on a copy into a read-only region or a
+      // copy-on-write fault with memory exhausted; the system call
+      // returns -1.  Any other kernel fault is a kernel bug, and
+      // panics below.
+      if((tf->cs&3) == 0 && va < KERNBASE &&
+         tf->eip >= (uint)copyuser && tf->eip < (uint)copyuserfault){
+        tf->eip = (uint)copyuserfault;
+        return;
+      }
+
       // Check if this is an illegal access (not mapped)
       // If the address is not in the process's address space, kill the process
-      if(va >= p->sz || va >= KERNBASE){
+      if((tf->cs&3) == DPL_USER && (va >= p->sz || va >= KERNBASE)){
         cprintf("pid %d %s: illegal page access at 0x%x\n",
                 p->pid, p->name, va);
         p->killed = 1;
@@ -141,9 +186,13 @@ default_handler:
 
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
+  // Preempted in user mode, its pages may be paged out meanwhile.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && schedtick()){
+    myproc()->uidle = (tf->cs&3) == DPL_USER;
     yield();
+    myproc()->uidle = 0;
+  }
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
@@ -1,5 +1,12 @@
 struct stat;
 struct rtcdate;
+struct bstat;
+struct logstat;
+struct schedstat;
+struct swapstat;
+struct lockstat;
+struct profsample;
+struct vmstat;
 
 // system calls
 int fork(void);
@@ -27,11 +34,23 @@ int hello(void);
 int numvp(void);
 int numpp(void);
 int getptsize(void);
-int mmap(int);
-char* mapshared(void);
-char* getshared(void);
-int unmapshared(void);
+char* mmap(void*, int, int, int, int, int);
+int shmget(int, int);
+char* shmat(int, void*);
+int shmdt(void*);
+int shmrm(int);
 int getNumFreePages(void);
+int munmap(void*, int);
+int faultaround(int);
+int pgfaults(void);
+int bstat(struct bstat*, int);
+int logstat(struct logstat*);
+int setpriority(int, int);
+int schedstat(struct schedstat*);
+int swapstat(struct swapstat*);
+int lockstat(struct lockstat*, int, int);
+int prof(int, struct profsample*, int);
+int vmstat(struct vmstat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -6,10 +6,58 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "vmstat.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// VM event counts, per CPU so that counting does not share cache lines.
+struct {
+  uint count[NVMEVENT];
+} vmstats[NCPU];
+
+// Count n VM events e for this CPU and the process running on it.
+void
+vmcount(int e, int n)
+{
+  struct cpu *c;
+
+  pushcli();
+  c = mycpu();
+  vmstats[c - cpus].count[e] += n;
+  if(c->proc)
+    c->proc->vmcount[e] += n;
+  popcli();
+}
+
+// Reload %cr3 after changing mappings in pgdir, which is in use,
+// to flush the stale entries from the TLB.
+void
+flushtlb(pde_t *pgdir)
+{
+  vmcount(VM_FLUSH, 1);
+  lcr3(V2P(pgdir));
+}
+
+// Copy the caller's, its reaped children's and the summed per-CPU
+// VM event counts to st, then clear the per-CPU counts if reset.
+void
+vmstat(struct vmstat *st, int reset)
+{
+  int i, e;
+
+  memset(st, 0, sizeof(*st));
+  memmove(st->proc, myproc()->vmcount, sizeof(st->proc));
+  memmove(st->child, myproc()->vmchild, sizeof(st->child));
+  for(i = 0; i < ncpu; i++){
+    for(e = 0; e < NVMEVENT; e++)
+      st->sys[e] += vmstats[i].count[e];
+    if(reset)
+      memset(&vmstats[i], 0, sizeof(vmstats[i]));
+  }
+  st->freepages = getNumFreePages();
+}
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -29,21 +77,99 @@ seginit(void)
   lgdt(c->gdt, sizeof(c->gdt));
 }
 
+// Page-table sharing (SHAREPT): fork() may hand the child the
+// parent's second-level page-table pages instead of copying them.
+// A shared table is mapped by a PDE without PTE_W, which makes the
+// whole 4MB region read-only for both sides, and is reference
+// counted with the same refcounts as data pages.  The first write
+// into the region, or any change to its mappings, gives the writer
+// a private copy of the table (unsharept).  Kernel PDEs always have
+// PTE_W set, so a present user PDE without PTE_W means "shared".
+
+// Drop one reference to a user page-table page.  The last
+// reference also frees the data pages it maps.
+static void
+droppt(pte_t *pt)
+{
+  uint i;
+
+  if(decref(V2P(pt)) > 0)
+    return;
+  for(i = 0; i < NPTENTRIES; i++){
+    if(pt[i] & PTE_P)
+      kfree(P2V(PTE_ADDR(pt[i])));
+    else if(pt[i] & PTE_SWAP)
+      swapfree(pt[i]);
+  }
+  kfree((char*)pt);
+}
+
+// Make sure the page-table page covering va is private to pgdir
+// and mapped writable.  Data pages that end up referenced from both
+// the old and the new table become copy-on-write.
+// The caller must flush the TLB if pgdir is live.
+// Returns 0 on success, -1 if out of memory.
+static int
+unsharept(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+  pte_t *pt, *npt;
+  uint i;
+  int nshared;
+
+  pde = &pgdir[PDX(va)];
+  if(!(*pde & PTE_P) || (*pde & (PTE_W|PTE_PS)))
+    return 0;
+  pt = (pte_t*)P2V(PTE_ADDR(*pde));
+  if(getrefcount(V2P(pt)) < 2){
+    // Everyone else has split off already; the table is ours.
+    *pde |= PTE_W;
+    return 0;
+  }
+  if((npt = (pte_t*)kalloc()) == 0)
+    return -1;
+  vmcount(VM_PTPAGE, 1);
+  nshared = 0;
+  for(i = 0; i < NPTENTRIES; i++){
+    if(pt[i] & PTE_P){
+      // Remaining sharers see the page through pt, we through npt.
+      if(!(pt[i] & (PTE_S|PTE_MAPSH)))
+        pt[i] &= ~PTE_W;
+      incref(PTE_ADDR(pt[i]));
+      nshared++;
+    } else if(pt[i] & PTE_SWAP)
+      swapdup(pt[i]);
+    npt[i] = pt[i];
+  }
+  *pde = V2P(npt) | PTE_P | PTE_W | PTE_U;
+  vmcount(VM_SHARE, nshared);
+  droppt(pt);
+  return 0;
+}
+
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
+// create any required page table pages, and unshare the
+// page table page if it is shared, since the caller is
+// about to change a mapping.  Returns 0 for an address in
+// a 4MB page, which has no PTE.
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;
   if(*pde & PTE_P){
+    if(alloc && !(*pde & PTE_W) && unsharept(pgdir, (uint)va) < 0)
+      return 0;
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
     if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
       return 0;
+    vmcount(VM_PTPAGE, 1);
     // Make sure all those PTE_P bits are zero.
     memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
@@ -79,52 +205,6 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
-// Find the virtual address of the first shared page (PTE_S) in the
-// user portion of the page table up to size 'sz'. Returns the virtual
-// address on success or -1 on failure.
-int
-find_shared(pde_t *pgdir, uint sz)
-{
-  pte_t *pte;
-  uint a;
-
-  a = 0;
-  while(a < sz && a < KERNBASE){
-    pte = walkpgdir(pgdir, (char*)a, 0);
-    if(pte && (*pte & PTE_S)){
-      return (int)a;
-    }
-    a += PGSIZE;
-  }
-  return -1;
-}
-
-// Unmap and free the shared page (if mapped) in the page table up to size 'sz'.
-// Returns the virtual address that was unmapped or -1 on failure.
-int
-unmap_shared(pde_t *pgdir, uint sz)
-{
-  pte_t *pte;
-  uint a, pa;
-
-  a = 0;
-  while(a < sz && a < KERNBASE){
-    pte = walkpgdir(pgdir, (char*)a, 0);
-    if(pte && (*pte & PTE_S)){
-      if((*pte & PTE_P) != 0){
-        pa = PTE_ADDR(*pte);
-        if(pa == 0)
-          panic("kfree");
-        kfree((char*)P2V(pa));
-      }
-      *pte = 0;
-      return (int)a;
-    }
-    a += PGSIZE;
-  }
-  return -1;
-}
-
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -145,6 +225,10 @@ unmap_shared(pde_t *pgdir, uint sz)
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
+//
+// Every 4MB-aligned stretch of these mappings is a single PTE_PS
+// page directory entry, so only the first 4MB, where the read-only
+// kernel text begins, needs a page-table page of its own.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -160,6 +244,32 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
+// Map size bytes of the kernel part of pgdir, va to pa, using
+// 4MB pages wherever both are aligned.
+static int
+mapkernel(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(va % HUGEPGSIZE == 0 && pa % HUGEPGSIZE == 0 && size >= HUGEPGSIZE){
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      n = HUGEPGSIZE;
+    } else {
+      // 4KB pages up to the next 4MB boundary.
+      n = HUGEPGSIZE - va % HUGEPGSIZE;
+      if(n > size)
+        n = size;
+      if(mappages(pgdir, (char*)va, n, pa, perm) < 0)
+        return -1;
+    }
+    va += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // Set up kernel part of a page table.
 pde_t*
 setupkvm(void)
@@ -173,8 +283,8 @@ setupkvm(void)
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
+    if(mapkernel(pgdir, (uint)k->virt, k->phys_end - k->phys_start,
+                 k->phys_start, k->perm) < 0) {
       freevm(pgdir);
       return 0;
     }
@@ -277,7 +387,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = swapkalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -297,10 +407,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or 0 if a shared
+// page table page could not be split.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
+  pde_t *pde;
   pte_t *pte;
   uint a, pa;
 
@@ -309,6 +421,25 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
+    pde = &pgdir[PDX(a)];
+    if(*pde & PTE_PS){
+      // A MAP_HUGE page; munmap has made sure it goes as a whole.
+      khugefree(P2V(PTE_ADDR(*pde)));
+      *pde = 0;
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((*pde & PTE_P) && !(*pde & PTE_W)){
+      if(PTX(a) == 0){
+        // Whole region goes away: just drop our share of the table.
+        droppt((pte_t*)P2V(PTE_ADDR(*pde)));
+        *pde = 0;
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      if(unsharept(pgdir, a) < 0)
+        return 0;
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
@@ -316,19 +447,55 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
-      // If this is a shared page, do not free it here - it will be
-      // freed explicitly by unmapshared() to avoid double-free when
-      // multiple processes reference the same physical page.
-      if(!(*pte & PTE_S)){
-        char *v = P2V(pa);
-        kfree(v);
-      }
+      char *v = P2V(pa);
+      kfree(v);
+      *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
       *pte = 0;
     }
   }
   return newsz;
 }
 
+// Remove the user mappings in [start, end), which must be page
+// aligned, and free the pages.  Unlike deallocuvm() there may be
+// mappings above end, so shared page tables are split rather than
+// dropped.  The caller must flush the TLB.
+// Returns 0 on success, -1 if a shared page table could not be split.
+int
+unmapuvm(pde_t *pgdir, uint start, uint end)
+{
+  pde_t *pde;
+  pte_t *pte;
+  uint a;
+
+  for(a = start; a < end; a += PGSIZE){
+    pde = &pgdir[PDX(a)];
+    if(*pde & PTE_PS){
+      if(a % HUGEPGSIZE != 0 || end - a < HUGEPGSIZE)
+        return -1;
+      khugefree(P2V(PTE_ADDR(*pde)));
+      *pde = 0;
+      a += HUGEPGSIZE - PGSIZE;
+      continue;
+    }
+    if(unsharept(pgdir, a) < 0)
+      return -1;
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_P)
+      kfree(P2V(PTE_ADDR(*pte)));
+    else if(*pte & PTE_SWAP)
+      swapfree(*pte);
+    *pte = 0;
+  }
+  return 0;
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -340,7 +507,7 @@ freevm(pde_t *pgdir)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS)){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -361,63 +528,112 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
+// Copy one page-table page of the parent into a fresh page-table
+// page for the child, covering user addresses [base, base+4MB) below sz.
+// Shared-memory segment (PTE_S) and MAP_SHARED mmap (PTE_MAPSH)
+// pages stay shared writable, and everything else becomes
+// copy-on-write by clearing PTE_W in both tables in the same pass.
+// Returns the number of parent PTEs that lost PTE_W (and so need a
+// TLB flush), or -1 if no page-table page could be allocated.
+static int
+copyuvm_pt(pte_t *ppt, pde_t *cpde, uint base, uint sz)
+{
+  pte_t *cpt, pte;
+  uint i, n;
+  int downgraded, nshared;
+
+  if((cpt = (pte_t*)kalloc()) == 0)
+    return -1;
+  vmcount(VM_PTPAGE, 1);
+  memset(cpt, 0, PGSIZE);
+  *cpde = V2P(cpt) | PTE_P | PTE_W | PTE_U;
+
+  n = NPTENTRIES;
+  if(sz - base < (uint)NPTENTRIES * PGSIZE)
+    n = PGROUNDUP(sz - base) / PGSIZE;
+
+  downgraded = nshared = 0;
+  for(i = 0; i < n; i++){
+    pte = ppt[i];
+    // Pages of lazily allocated (mmap'd or not yet touched) regions
+    // are simply absent; the child will fault them in itself.
+    // Paged-out pages are shared through the swap slot.
+    if(!(pte & PTE_P)){
+      if(pte & PTE_SWAP){
+        swapdup(pte);
+        cpt[i] = pte;
+      }
+      continue;
+    }
+    if((pte & PTE_W) && !(pte & (PTE_S|PTE_MAPSH))){
+      pte &= ~PTE_W;
+      ppt[i] = pte;
+      downgraded++;
+    }
+    incref(PTE_ADDR(pte));
+    cpt[i] = pte;
+    nshared++;
+  }
+  vmcount(VM_SHARE, nshared);
+  return downgraded;
+}
+
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  Walks the parent one page directory entry
+// at a time, so each page-table page is visited once and the TLB
+// is flushed at most once, and only if a mapping lost PTE_W.
+// With SHAREPT, page-table pages are not copied at all: the child
+// gets the parent's PDE and both lose PTE_W at the PDE level.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte, *parent_pte;
-  uint pa, i, flags;
+  uint pdx, base;
+  int n, flush;
+  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    
-    // If this page is marked shared, map the same physical page
-    // into the child's address space (do not allocate/copy).
-    if(flags & PTE_S) {
-      // map same physical address, preserving flags
-      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0) {
-        goto bad;
-      }
-    } else {
-      // CoW: Share the page instead of copying
-      // Remove write permission from both parent and child, but keep other flags (PTE_U, etc.)
-      flags = flags & ~PTE_W;  // Remove write bit, preserve other flags
-      
-      // Increment reference count BEFORE mapping child (so refcount is correct)
-      // This ensures refcount is 2 (parent=1, child=1) after fork
-      incref(pa);
-      
-      // Map the same physical page to child (read-only)
-      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0) {
+  flush = 0;
+  for(base = 0; base < sz && base < KERNBASE; base += (uint)NPTENTRIES * PGSIZE){
+    pdx = PDX(base);
+    if(!(pgdir[pdx] & PTE_P))
+      continue;
+    if(pgdir[pdx] & PTE_PS){
+      // MAP_HUGE regions are private, so the child gets a copy.
+      if((mem = khugealloc()) == 0)
         goto bad;
+      memmove(mem, P2V(PTE_ADDR(pgdir[pdx])), HUGEPGSIZE);
+      d[pdx] = V2P(mem) | PTE_FLAGS(pgdir[pdx]);
+      continue;
+    }
+    if(SHAREPT){
+      if(pgdir[pdx] & PTE_W){
+        pgdir[pdx] &= ~PTE_W;
+        flush = 1;
       }
-      
-      // Make parent's page read-only too
-      // Note: pte and parent_pte point to the same entry, but we use parent_pte for clarity
-      parent_pte = walkpgdir(pgdir, (void*)i, 0);
-      if(parent_pte == 0)
-        panic("copyuvm: parent pte should exist");
-      // Update parent PTE: keep physical address, use new flags (read-only), ensure PTE_P is set
-      *parent_pte = pa | flags | PTE_P;
+      incref(PTE_ADDR(pgdir[pdx]));
+      d[pdx] = pgdir[pdx];
+      continue;
     }
+    n = copyuvm_pt((pte_t*)P2V(PTE_ADDR(pgdir[pdx])), &d[pdx], base, sz);
+    if(n < 0)
+      goto bad;
+    flush |= n;
   }
-  
-  // Flush TLB for parent process (since we modified its page table)
-  lcr3(V2P(pgdir));
-  
+
+  // Flush TLB for parent process if we write-protected any of its pages.
+  if(flush)
+    flushtlb(pgdir);
+
   return d;
 
 bad:
+  // Pages already made read-only in the parent stay that way;
+  // cowfault() will restore PTE_W once their refcount drops.
   freevm(d);
+  if(flush)
+    flushtlb(pgdir);
   return 0;
 }
 
@@ -473,6 +689,11 @@ countppages(pde_t *pgdir, uint sz)
   count = 0;
   a = 0;
   while(a < sz && a < KERNBASE){
+    if(pgdir[PDX(a)] & PTE_PS){
+      count += NPTENTRIES;
+      a += HUGEPGSIZE;
+      continue;
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(pte != 0 && (*pte & PTE_P) != 0){
       count++;
@@ -483,7 +704,9 @@ countppages(pde_t *pgdir, uint sz)
 }
 
 // Count the number of page table pages used by a process
-// This includes the page directory and all inner page table pages
+// This includes the page directory and all inner page table pages,
+// except page table pages still shared with another process
+// (see SHAREPT), which are not charged to anyone.
 uint
 countpagepages(pde_t *pgdir)
 {
@@ -493,7 +716,11 @@ countpagepages(pde_t *pgdir)
   count = 1;  // Count the page directory itself
   for(i = 0; i < NPDENTRIES; i++){
     pde = pgdir[i];
-    if(pde & PTE_P){
+    // 4MB pages need no page table
+    if((pde & PTE_P) && !(pde & PTE_PS)){
+      // Skip tables shared after fork
+      if(!(pde & PTE_W) && getrefcount(PTE_ADDR(pde)) > 1)
+        continue;
       // This page table exists, count it
       count++;
     }
@@ -503,17 +730,25 @@ countpagepages(pde_t *pgdir)
 
 // Allocate a single page of physical memory for the given virtual address
 // Used for on-demand memory allocation during page faults
+// perm holds the PTE bits to map the page with (PTE_U and friends)
 // Returns 0 on success, -1 on error
 int
-allocuvm_ondemand(pde_t *pgdir, uint va)
+allocuvm_ondemand(pde_t *pgdir, uint va, int perm)
 {
   char *mem;
+  pte_t *pte;
   
   // Round down to page boundary
   va = PGROUNDDOWN(va);
+
+  // A fault on a page that is already mapped is a protection
+  // fault (e.g. the stack guard page), not a lazy allocation.
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte && (*pte & (PTE_P|PTE_SWAP)))
+    return -1;
   
   // Allocate physical memory
-  mem = kalloc();
+  mem = swapkalloc();
   if(mem == 0){
     cprintf("allocuvm_ondemand out of memory\n");
     return -1;
@@ -523,15 +758,58 @@ allocuvm_ondemand(pde_t *pgdir, uint va)
   memset(mem, 0, PGSIZE);
   
   // Map the physical page to the virtual address
-  if(mappages(pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+  if(mappages(pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
     cprintf("allocuvm_ondemand mapping failed\n");
     kfree(mem);
     return -1;
   }
+  vmcount(VM_ZERO, 1);
   
   return 0;
 }
 
+// Map a zeroed 4MB page at va, which must be aligned and have no
+// mappings, for a MAP_HUGE region.  Returns 0 on success, -1 if
+// the huge page reserve is used up.
+int
+maphugepage(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+  char *mem;
+
+  pde = &pgdir[PDX(va)];
+  if((*pde & PTE_PS) || va % HUGEPGSIZE != 0)
+    return -1;
+  if((mem = khugealloc()) == 0)
+    return -1;
+  memset(mem, 0, HUGEPGSIZE);
+  // An empty page table may be left over from earlier mappings;
+  // the TLB may still hold the PDE that pointed to it.
+  if(*pde & PTE_P){
+    droppt((pte_t*)P2V(PTE_ADDR(*pde)));
+    *pde = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+    flushtlb(pgdir);
+    return 0;
+  }
+  *pde = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+  return 0;
+}
+
+// Map the shared zero page read-only at va.  The first write
+// to it takes a copy-on-write fault like any shared page.
+// Returns 0 on success, -1 on error.
+int
+mapzeropage(pde_t *pgdir, uint va)
+{
+  incref(V2P(zeropage));
+  if(mappages(pgdir, (char*)va, PGSIZE, V2P(zeropage), PTE_U) < 0){
+    kfree(zeropage);
+    return -1;
+  }
+  vmcount(VM_ZERO, 1);
+  return 0;
+}
+
 // Handle copy-on-write page fault
 // Returns 0 on success, -1 on error
 int
@@ -540,23 +818,34 @@ cowfault(pde_t *pgdir, uint va)
   pte_t *pte;
   uint pa;
   char *mem;
-  int ref;
+  int ref, sharedpt;
   
   // Round down to page boundary
   va = PGROUNDDOWN(va);
+
+  // A write into a region whose page table is shared after fork
+  // first needs a private page table.
+  sharedpt = (pgdir[PDX(va)] & PTE_P) && !(pgdir[PDX(va)] & PTE_W);
+  if(sharedpt && unsharept(pgdir, va) < 0)
+    return -1;
   
   // Get the page table entry
   pte = walkpgdir(pgdir, (char*)va, 0);
   if(pte == 0)
     return -1;
   
-  if(!(*pte & PTE_P))
+  if(!(*pte & PTE_P) || !(*pte & PTE_U))
     return -1;
   
   // Check if this is a write fault on a read-only page (CoW)
-  // If the page is writable, it's not a CoW fault
-  if(*pte & PTE_W)
-    return -1;
+  // If the page is writable, it's not a CoW fault, unless it was
+  // only read-only because of the shared page table.
+  if(*pte & PTE_W){
+    if(!sharedpt)
+      return -1;
+    flushtlb(pgdir);
+    return 0;
+  }
   
   pa = PTE_ADDR(*pte);
   ref = getrefcount(pa);
@@ -567,34 +856,91 @@ cowfault(pde_t *pgdir, uint va)
   // - 1: Only one process references it (shouldn't happen for CoW, but handle it)
   // In both cases, we can just make it writable without copying
   if(ref < 2) {
-    // Not shared (or tracking issue) - just make it writable
+    // Not shared (or tracking issue) - just make it writable.
+    // This is also the common case right after unsharept().
     *pte = pa | PTE_FLAGS(*pte) | PTE_W | PTE_P;
+    vmcount(VM_COWREUSE, 1);
     // Flush TLB
-    lcr3(V2P(pgdir));
+    flushtlb(pgdir);
     return 0;
   }
   
   // ref >= 2: Multiple processes share this page, need to copy
   // Allocate new page
-  mem = kalloc();
+  mem = swapkalloc();
   if(mem == 0)
     return -1;
   
   // Copy content from original page
   memmove(mem, (char*)P2V(pa), PGSIZE);
   
-  // Decrement reference count for original page
-  decref(pa);
+  // Drop our reference to the original page.  kfree() frees it if
+  // the other sharers let go of it while we were copying.
+  kfree((char*)P2V(pa));
   
   // Map new page with write permission
   *pte = V2P(mem) | (PTE_FLAGS(*pte) | PTE_W) | PTE_P;
+  vmcount(VM_COW, 1);
   
   // Flush TLB
-  lcr3(V2P(pgdir));
+  flushtlb(pgdir);
   
   return 0;
 }
 
+// Return the PTE of the present, private user page at va, if it is
+// mapped through a page table of pgdir's own, else 0.
+static pte_t*
+privatepte(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  if(va >= KERNBASE || (pgdir[PDX(va)] & (PTE_P|PTE_W|PTE_PS)) != (PTE_P|PTE_W))
+    return 0;
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U) || (*pte & (PTE_S|PTE_MAPSH)))
+    return 0;
+  return pte;
+}
+
+// Lend the page at va, which must be page aligned, to a pipe: take
+// a reference to it and make the mapping copy-on-write, so that the
+// process's later writes do not change what the pipe holds.
+// Returns the physical address, or 0 if the page cannot be lent
+// and must be copied.
+uint
+pageloan(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  if((pte = privatepte(pgdir, va)) == 0)
+    return 0;
+  incref(PTE_ADDR(*pte));
+  if(*pte & PTE_W){
+    *pte &= ~PTE_W;
+    flushtlb(pgdir);
+  }
+  return PTE_ADDR(*pte);
+}
+
+// Map the lent page pa copy-on-write at va in place of the writable
+// page there, taking over the caller's reference to pa.  Returns 0
+// on success, -1 if va is not a private writable page.
+int
+pagerecv(pde_t *pgdir, uint va, uint pa)
+{
+  pte_t *pte;
+  uint old;
+
+  if((pte = privatepte(pgdir, va)) == 0 || !(*pte & PTE_W))
+    return -1;
+  old = PTE_ADDR(*pte);
+  *pte = pa | (PTE_FLAGS(*pte) & ~(PTE_W|PTE_D));
+  flushtlb(pgdir);
+  kfree(P2V(old));
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
@@ -0,0 +1,61 @@
+// Print VM event counts.  Given a command, clear the system-wide
+// counts, run it and report what it caused, e.g. "vmstat forkbench".
+//
+// usage: vmstat [-r | command [args...]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "vmstat.h"
+
+char *names[NVMEVENT] = {
+[VM_FAULT]    "faults",
+[VM_COW]      "cow-copies",
+[VM_COWREUSE] "cow-reuses",
+[VM_ZERO]     "zero-fills",
+[VM_FLUSH]    "tlb-flushes",
+[VM_SHARE]    "pages-shared",
+[VM_PTPAGE]   "pt-pages",
+};
+
+void
+pad(char *s, int w)
+{
+  printf(1, "%s", s);
+  for(w -= strlen(s); w > 0; w--)
+    printf(1, " ");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat st;
+  int i;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    vmstat(&st, 1);
+    exit();
+  }
+  if(argc > 1){
+    vmstat(&st, 1);
+    if(fork() == 0){
+      exec(argv[1], argv + 1);
+      printf(2, "vmstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  if(vmstat(&st, 0) < 0){
+    printf(2, "vmstat: failed\n");
+    exit();
+  }
+  printf(1, "event         system      command\n");
+  for(i = 0; i < NVMEVENT; i++){
+    pad(names[i], 14);
+    printf(1, "%d  %d\n", st.sys[i], st.child[i]);
+  }
+  printf(1, "free pages: %d\n", st.freepages);
+  exit();
+}
@@ -0,0 +1,16 @@
+// Virtual memory events, counted per process and per CPU.
+#define VM_FAULT     0  // Page faults
+#define VM_COW       1  // Copy-on-write faults that copied the page
+#define VM_COWREUSE  2  // Copy-on-write faults that kept it (ref < 2)
+#define VM_ZERO      3  // Demand-zero pages mapped
+#define VM_FLUSH     4  // TLB flushes after page table changes
+#define VM_SHARE     5  // Pages shared, not copied, by fork or a table split
+#define VM_PTPAGE    6  // Page-table pages allocated (NVMEVENT in param.h)
+
+// VM statistics, returned by vmstat().
+struct vmstat {
+  uint proc[NVMEVENT];  // The calling process
+  uint child[NVMEVENT]; // Its children that wait() has reaped
+  uint sys[NVMEVENT];   // All CPUs, since boot or the last reset
+  uint freepages;       // Free physical pages
+};